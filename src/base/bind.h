@@ -23,44 +23,45 @@ Apply(
       std::forward<Args>(args)...);
 }
 
-// The type returned by Bind().
+// The type returned by Bind() and BindLocal(); see Callback and LocalCallback
+// below.
 //
-// Callbacks can be copied and used concurrently. Copies are cheap, since they
-// only copy a pointer to shared storage.
-template<typename Function, typename... BoundArgs>
-class Callback {
+// Copies are cheap, since they only copy a pointer to shared storage and
+// update its |RefCount|.
+template<typename RefCount, typename Function, typename... BoundArgs>
+class BasicCallback {
  public:
   template<typename InFunction, typename... InBoundArgs>
-  explicit Callback(InFunction&& function, InBoundArgs&&... bound_args)
+  explicit BasicCallback(InFunction&& function, InBoundArgs&&... bound_args)
       : shared_storage_(new SharedStorage(
             std::forward<InFunction>(function),
             std::forward<InBoundArgs>(bound_args)...)) {}
 
-  Callback(const Callback& callback)
+  BasicCallback(const BasicCallback& callback)
       : shared_storage_(callback.shared_storage_) {
     if (shared_storage_)
-      shared_storage_->Ref();
+      shared_storage_->ref_count_.Ref();
   }
 
-  Callback(Callback& callback)
+  BasicCallback(BasicCallback& callback)
       : shared_storage_(callback.shared_storage_) {
     if (shared_storage_)
-      shared_storage_->Ref();
+      shared_storage_->ref_count_.Ref();
   }
 
-  Callback(Callback&& callback)
+  // This is noexcept so that OnceCallbacks keep the pointer inline.
+  BasicCallback(BasicCallback&& callback) noexcept
       : shared_storage_(callback.shared_storage_) {
     callback.shared_storage_ = NULL;
   }
 
-  ~Callback() {
-    if (shared_storage_)
-      shared_storage_->Unref();
+  ~BasicCallback() {
+    Reset();
   }
 
   void Reset() {
-    if (shared_storage_)
-      shared_storage_->Unref();
+    if (shared_storage_ && shared_storage_->ref_count_.Unref())
+      delete shared_storage_;
     shared_storage_ = NULL;
   }
 
@@ -72,9 +73,11 @@ class Callback {
   typename CallableTraits<Function>::return_type
   operator()(Args&&... args) const {
     DCHECK(shared_storage_);
-    return Apply(
+    // The bound arguments are shared with the other copies, and might be used
+    // again; they can't be moved into the call.
+    return internal::UnpackTuple<sizeof...(BoundArgs)>::unpack(
         shared_storage_->function_,
-        std::forward<std::tuple<BoundArgs...>>(shared_storage_->bound_args_),
+        shared_storage_->bound_args_,
         std::forward<Args>(args)...);
   }
 
@@ -82,28 +85,10 @@ class Callback {
   struct SharedStorage {
     template<typename InFunction, typename... InBoundArgs>
     SharedStorage(InFunction&& function, InBoundArgs&&... bound_args)
-        : ref_count_(1),
-          function_(std::forward<InFunction>(function)),
+        : function_(std::forward<InFunction>(function)),
           bound_args_(std::forward<InBoundArgs>(bound_args)...) {}
 
-    void Ref() {
-      ScopedLock scoped_lock(lock_);
-      ref_count_++;
-    }
-
-    void Unref() {
-      bool was_last = false;
-      {
-        ScopedLock scoped_lock(lock_);
-        ref_count_--;
-        was_last = ref_count_ == 0;
-      }
-      if (was_last)
-        delete this;
-    }
-
-    Lock lock_;
-    size_t ref_count_;
+    RefCount ref_count_;
     Function function_;
     std::tuple<BoundArgs...> bound_args_;
   };
@@ -111,6 +96,47 @@ class Callback {
   SharedStorage* shared_storage_;
 };
 
+// Callbacks can be copied and used concurrently.
+template<typename Function, typename... BoundArgs>
+using Callback =
+    BasicCallback<internal::AtomicRefCount, Function, BoundArgs...>;
+
+// LocalCallbacks skip the atomic operations, so all the copies must be made
+// and deleted on the same thread; for callbacks that never leave their
+// EventLoop, for example.
+template<typename Function, typename... BoundArgs>
+using LocalCallback =
+    BasicCallback<internal::LocalRefCount, Function, BoundArgs...>;
+
+// The type returned by BindOnce().
+//
+// OnceBindings are move-only, and keep the callable and the bound arguments
+// inline. They can only be run once, since the bound arguments are moved into
+// the call; this lets them bind move-only arguments like unique_ptrs.
+template<typename Function, typename... BoundArgs>
+class OnceBinding {
+ public:
+  template<typename InFunction, typename... InBoundArgs>
+  explicit OnceBinding(InFunction&& function, InBoundArgs&&... bound_args)
+      : function_(std::forward<InFunction>(function)),
+        bound_args_(std::forward<InBoundArgs>(bound_args)...) {}
+
+  OnceBinding(OnceBinding&& binding) = default;
+
+  template<typename... Args>
+  typename CallableTraits<Function>::return_type
+  operator()(Args&&... args) {
+    return Apply(function_, std::move(bound_args_),
+                 std::forward<Args>(args)...);
+  }
+
+ private:
+  Function function_;
+  std::tuple<BoundArgs...> bound_args_;
+
+  DISALLOW_COPY_AND_ASSIGN(OnceBinding);
+};
+
 // Binds the given arguments to the given callable.
 //
 // The |function| can be a function, method or std::function.
@@ -131,4 +157,33 @@ Bind(Function&& function, BoundArgs&&... bound_args) {
                       std::forward<BoundArgs>(bound_args)...);
 }
 
+// Like Bind(), but returns a LocalCallback.
+template<typename Function, typename... BoundArgs>
+inline
+LocalCallback<
+    typename std::decay<Function>::type,
+    typename std::decay<BoundArgs>::type...>
+BindLocal(Function&& function, BoundArgs&&... bound_args) {
+  typedef LocalCallback<
+      typename std::decay<Function>::type,
+      typename std::decay<BoundArgs>::type...> CallbackType;
+  return CallbackType(std::forward<Function>(function),
+                      std::forward<BoundArgs>(bound_args)...);
+}
+
+// Like Bind(), but returns a OnceBinding. Pass it to a OnceCallback, like
+// EventLoop::Callback, to post it without allocating.
+template<typename Function, typename... BoundArgs>
+inline
+OnceBinding<
+    typename std::decay<Function>::type,
+    typename std::decay<BoundArgs>::type...>
+BindOnce(Function&& function, BoundArgs&&... bound_args) {
+  typedef OnceBinding<
+      typename std::decay<Function>::type,
+      typename std::decay<BoundArgs>::type...> BindingType;
+  return BindingType(std::forward<Function>(function),
+                     std::forward<BoundArgs>(bound_args)...);
+}
+
 #endif  // BASE_BIND_H
@@ -0,0 +1,152 @@
+#include <malloc.h>
+
+#include <functional>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/lock.h"
+#include "base/once_callback.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// The mutex that Callback used before AtomicRefCount.
+class LockedRefCount {
+ public:
+  LockedRefCount() : count_(1) {}
+
+  void Ref() {
+    ScopedLock lock(lock_);
+    count_++;
+  }
+
+  bool Unref() {
+    ScopedLock lock(lock_);
+    return --count_ == 0;
+  }
+
+ private:
+  Lock lock_;
+  size_t count_;
+};
+
+void add(int* sum, int value) {
+  *sum += value;
+}
+
+template<typename RefCount>
+BasicCallback<RefCount, void (*)(int*, int), int*, int> make_callback(
+    int* sum) {
+  typedef BasicCallback<RefCount, void (*)(int*, int), int*, int> Type;
+  return Type(&add, sum, 1);
+}
+
+// Copies a callback and drops the copy, like posting it does. With more than
+// one thread they all copy the same callback.
+template<typename RefCount>
+void BM_CopyCallback(benchmark::State& state) {
+  typedef decltype(make_callback<RefCount>(NULL)) Type;
+  static int sum;
+  static Type* callback;
+  if (state.thread_index() == 0)
+    callback = new Type(make_callback<RefCount>(&sum));
+  for (auto _: state) {
+    Type copy(*callback);
+    benchmark::DoNotOptimize(&copy);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    delete callback;
+}
+
+size_t heap_in_use() {
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// The heap used by each bound callback, including the allocator's overhead.
+template<typename RefCount>
+void BM_CallbackFootprint(benchmark::State& state) {
+  typedef decltype(make_callback<RefCount>(NULL)) Type;
+  int sum = 0;
+  std::vector<Type> callbacks;
+  callbacks.reserve(state.range(0));
+  size_t bytes = 0;
+  for (auto _: state) {
+    size_t before = heap_in_use();
+    for (int i = 0; i < state.range(0); ++i)
+      callbacks.push_back(make_callback<RefCount>(&sum));
+    bytes = heap_in_use() - before;
+    state.PauseTiming();
+    callbacks.clear();
+    state.ResumeTiming();
+  }
+  if (!heap_in_use())
+    state.SkipWithError("mallinfo2() isn't available");
+  state.counters["bytes_per_callback"] = (double) bytes / state.range(0);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Each of these returns a callable that adds 1 to |sum|.
+auto make_bind = [](int* sum) { return Bind(add, sum, 1); };
+auto make_bind_once = [](int* sum) { return BindOnce(add, sum, 1); };
+auto make_lambda = [](int* sum) { return [sum] { add(sum, 1); }; };
+auto make_std_bind = [](int* sum) { return std::bind(add, sum, 1); };
+auto make_std_function = [](int* sum) {
+  return std::function<void()>([sum] { add(sum, 1); });
+};
+auto make_once_callback = [](int* sum) {
+  return OnceCallback<void()>(BindOnce(add, sum, 1));
+};
+
+// Creates a callable and drops it.
+template<typename Make>
+void BM_Create(benchmark::State& state, Make make) {
+  int sum = 0;
+  for (auto _: state) {
+    auto f = make(&sum);
+    benchmark::DoNotOptimize(&f);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Invokes the same callable repeatedly.
+template<typename Make>
+void BM_Invoke(benchmark::State& state, Make make) {
+  int sum = 0;
+  auto f = make(&sum);
+  for (auto _: state) {
+    f();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_Create, bind, make_bind);
+BENCHMARK_CAPTURE(BM_Create, bind_once, make_bind_once);
+BENCHMARK_CAPTURE(BM_Create, lambda, make_lambda);
+BENCHMARK_CAPTURE(BM_Create, std_bind, make_std_bind);
+BENCHMARK_CAPTURE(BM_Create, std_function, make_std_function);
+BENCHMARK_CAPTURE(BM_Create, once_callback, make_once_callback);
+
+BENCHMARK_CAPTURE(BM_Invoke, bind, make_bind);
+BENCHMARK_CAPTURE(BM_Invoke, lambda, make_lambda);
+BENCHMARK_CAPTURE(BM_Invoke, std_bind, make_std_bind);
+BENCHMARK_CAPTURE(BM_Invoke, std_function, make_std_function);
+
+BENCHMARK_TEMPLATE(BM_CopyCallback, LockedRefCount)->ThreadRange(1, 4);
+BENCHMARK_TEMPLATE(BM_CopyCallback, internal::AtomicRefCount)
+    ->ThreadRange(1, 4);
+BENCHMARK_TEMPLATE(BM_CopyCallback, internal::LocalRefCount);
+
+BENCHMARK_TEMPLATE(BM_CallbackFootprint, LockedRefCount)->Arg(10000);
+BENCHMARK_TEMPLATE(BM_CallbackFootprint, internal::AtomicRefCount)
+    ->Arg(10000);
+BENCHMARK_TEMPLATE(BM_CallbackFootprint, internal::LocalRefCount)
+    ->Arg(10000);
@@ -1,8 +1,12 @@
 #ifndef BASE_BIND_INTERNAL_H
 #define BASE_BIND_INTERNAL_H
 
+#include <atomic>
 #include <tuple>
+#include <type_traits>
 
+#include "base/logging.h"
+#include "base/thread_checker.h"
 #include "base/traits.h"
 #include "base/weak.h"
 
@@ -10,21 +14,76 @@
 // directly.
 namespace internal {
 
+// The reference counts of the storage that the copies of a Callback share.
+// Unref() returns true when the last reference is gone.
+class AtomicRefCount {
+ public:
+  AtomicRefCount() : count_(1) {}
+
+  void Ref() {
+    count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool Unref() {
+    // Whoever deletes the storage sees all the changes of the other owners.
+    return count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+ private:
+  std::atomic<size_t> count_;
+};
+
+// For the copies that stay on the thread that created the first one.
+class LocalRefCount {
+ public:
+  LocalRefCount() : count_(1) {}
+
+  void Ref() {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    count_++;
+  }
+
+  bool Unref() {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    return --count_ == 0;
+  }
+
+ private:
+  size_t count_;
+#if !defined(NDEBUG)
+  ThreadChecker checker_;
+#endif
+};
+
+template<typename T>
+struct IsWeakPtr {
+  static const bool value = false;
+};
+
+template<typename T>
+struct IsWeakPtr<WeakPtr<T>> {
+  static const bool value = true;
+};
+
 // Removes content from an std::tuple and passes it as arguments to a function.
+// The elements of an rvalue |tuple| are moved into the call, and the ones of
+// an lvalue |tuple| are passed as lvalues.
 template<std::size_t N>
 struct UnpackTuple {
-  template<typename Function, typename... TupleArgs, typename... Args>
+  template<typename Function, typename Tuple, typename... Args>
   inline static typename CallableTraits<Function>::return_type
   unpack(
       const Function& function,
-      std::tuple<TupleArgs...>&& tuple,
+      Tuple&& tuple,
       Args&&... args) {
-    typedef std::tuple<TupleArgs...> TupleType;
-    typedef typename std::tuple_element<N-1, TupleType>::type ElementType;
     return UnpackTuple<N-1>::unpack(
         function,
-        std::forward<std::tuple<TupleArgs...>>(tuple),
-        std::forward<ElementType>(std::get<N-1>(tuple)),
+        std::forward<Tuple>(tuple),
+        std::get<N-1>(std::forward<Tuple>(tuple)),
         std::forward<Args>(args)...);
   }
 };
@@ -35,7 +94,7 @@ template<>
 struct UnpackTuple<0> {
   // Special case for methods.
   // The Pointer& type is such that it supports smart pointers such as
-  // std::unique_ptr too.
+  // std::unique_ptr too, but not WeakPtrs; those are handled below.
   template<
       typename T,
       typename... MethodArgs,
@@ -43,7 +102,8 @@ struct UnpackTuple<0> {
       typename... TupleArgs,
       typename Pointer,
       typename... Args>
-  inline static Return
+  inline static typename std::enable_if<
+      !IsWeakPtr<typename std::decay<Pointer>::type>::value, Return>::type
   unpack(
       Return (T::*method)(MethodArgs...),
       const std::tuple<TupleArgs...>& tuple,
@@ -60,7 +120,8 @@ struct UnpackTuple<0> {
       typename... TupleArgs,
       typename Pointer,
       typename... Args>
-  inline static Return
+  inline static typename std::enable_if<
+      !IsWeakPtr<typename std::decay<Pointer>::type>::value, Return>::type
   unpack(
       Return (T::*method)(MethodArgs...) const,
       const std::tuple<TupleArgs...>& tuple,
@@ -70,19 +131,20 @@ struct UnpackTuple<0> {
   }
 
   // Special case for methods of WeakPtrs.
-  // WeakPtr<T2> is used instead of WeakPtr<T>, so that methods of superclasses
+  // Any WeakPtr is taken, not just WeakPtr<T>, so that methods of superclasses
   // can be bound to WeakPtrs of derived classes.
   template<
       typename T,
-      typename T2,
       typename... MethodArgs,
       typename... TupleArgs,
+      typename Pointer,
       typename... Args>
-  inline static void
+  inline static typename std::enable_if<
+      IsWeakPtr<typename std::decay<Pointer>::type>::value>::type
   unpack(
       void (T::*method)(MethodArgs...),
       const std::tuple<TupleArgs...>& tuple,
-      WeakPtr<T2>&& weak_ptr,
+      Pointer&& weak_ptr,
       Args&&... args) {
     if (weak_ptr)
       return ((*weak_ptr).*method)(std::forward<Args>(args)...);
@@ -91,15 +153,16 @@ struct UnpackTuple<0> {
   // Special case for const methods of WeakPtrs.
   template<
       typename T,
-      typename T2,
       typename... MethodArgs,
       typename... TupleArgs,
+      typename Pointer,
       typename... Args>
-  inline static void
+  inline static typename std::enable_if<
+      IsWeakPtr<typename std::decay<Pointer>::type>::value>::type
   unpack(
       void (T::*method)(MethodArgs...) const,
       const std::tuple<TupleArgs...>& tuple,
-      WeakPtr<T2>&& weak_ptr,
+      Pointer&& weak_ptr,
       Args&&... args) {
     if (weak_ptr)
       return ((*weak_ptr).*method)(std::forward<Args>(args)...);
@@ -1,6 +1,8 @@
 #include "base/bind.h"
 
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "base/unittest.h"
 #include "base/weak.h"
@@ -107,6 +109,8 @@ void MergeRef(std::string& to, std::string from) {
   to += from;
 }
 
+void Drop(unique_ptr<Zombie> zombie) {}
+
 const char kAA[] = "111";
 const char kBB[] = "222";
 const char kCC[] = "333";
@@ -328,6 +332,69 @@ TEST(BindTest, UniquePtr) {
   EXPECT_FALSE(alive);
 }
 
+TEST(BindTest, SharedAcrossThreads) {
+  bool alive = true;
+  {
+    auto cb = Bind(&Zombie::alive,
+                   std::shared_ptr<Zombie>(new Zombie(&alive)));
+    // The copies made and dropped concurrently release the storage once.
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+      threads.push_back(std::thread([cb] {
+        for (int j = 0; j < 1000; ++j) {
+          auto copy = cb;
+          EXPECT_TRUE(copy());
+        }
+      }));
+    }
+    for (std::thread& thread: threads)
+      thread.join();
+    EXPECT_TRUE(alive);
+  }
+  EXPECT_FALSE(alive);
+}
+
+TEST(BindTest, Local) {
+  bool alive = true;
+  {
+    auto cb = BindLocal(&Zombie::alive,
+                        unique_ptr<Zombie>(new Zombie(&alive)));
+    {
+      auto copy = cb;
+      EXPECT_TRUE(copy());
+    }
+    EXPECT_TRUE(alive);
+    std::function<bool()> f = std::move(cb);
+    EXPECT_FALSE(cb);
+    EXPECT_TRUE(f());
+  }
+  EXPECT_FALSE(alive);
+}
+
+TEST(BindTest, Once) {
+  bool alive = true;
+  unique_ptr<Zombie> zombie(new Zombie(&alive));
+  {
+    // The bound Zombie is moved into the call.
+    auto cb = BindOnce(Drop, std::move(zombie));
+    auto moved = std::move(cb);
+    EXPECT_TRUE(alive);
+    moved();
+    EXPECT_FALSE(alive);
+  }
+
+  // Callbacks can be run again, so they pass their copy of the bound
+  // arguments.
+  std::string to;
+  auto cb = Bind(MergeRef, std::ref(to), kAA);
+  auto cb2 = Bind(Merge, std::string(kAA), kBB);
+  cb();
+  cb();
+  EXPECT_EQ(std::string(kAA) + kAA, to);
+  EXPECT_EQ(kMerged, cb2(kCC));
+  EXPECT_EQ(kMerged, cb2(kCC));
+}
+
 TEST(BindTest, BindBind) {
   auto func = std::bind(Merge, _2, "+", _1);
   auto cb = Bind(std::move(func), "123");
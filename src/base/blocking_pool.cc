@@ -0,0 +1,201 @@
+#include "base/blocking_pool.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+
+BlockingPool::Options::Options()
+    : min_threads(0),
+      max_threads(32),
+      idle_timeout(10000),
+      max_queued(1024) {
+  // Any one category can take up to half of the threads.
+  for (int i = 0; i < kCategories; ++i)
+    category_limits[i] = max_threads / 2;
+}
+
+BlockingPool::BlockingPool(const Options& options)
+    : options_(options),
+      queued_(0),
+      busy_(0),
+      next_sequence_(0),
+      completed_(0),
+      rejected_(0),
+      starting_(0),
+      idle_(0),
+      quit_(false) {
+  for (int i = 0; i < kCategories; ++i)
+    running_[i] = 0;
+}
+
+BlockingPool::~BlockingPool() {
+  std::vector<std::thread> exited;
+  {
+    std::unique_lock<Lock> lock(lock_);
+    quit_ = true;
+    work_posted_.notify_all();
+    while (!workers_.empty())
+      work_done_.wait(lock);
+    exited.swap(exited_);
+  }
+  for (std::thread& thread: exited)
+    thread.join();
+}
+
+// static
+unique_ptr<BlockingPool> BlockingPool::Create(const Options& options) {
+  DCHECK(options.max_threads > 0);
+  DCHECK(options.min_threads <= options.max_threads);
+  for (int i = 0; i < kCategories; ++i)
+    DCHECK(options.category_limits[i] > 0);
+  return make_unique(new BlockingPool(options));
+}
+
+// static
+BlockingPool* BlockingPool::Shared() {
+  static BlockingPool* shared = Create().release();
+  return shared;
+}
+
+bool BlockingPool::Post(Category category, Callback&& f) {
+  Task task = { std::forward<Callback>(f), NULL, Callback(), 0 };
+  return Push(category, std::move(task));
+}
+
+bool BlockingPool::PostAndReply(Category category, Callback&& f,
+                                Callback&& reply) {
+  DCHECK(EventLoop::Current());
+  Task task = { std::forward<Callback>(f), EventLoop::Current(),
+                std::forward<Callback>(reply), 0 };
+  return Push(category, std::move(task));
+}
+
+void BlockingPool::WaitUntilIdle() {
+  std::unique_lock<Lock> lock(lock_);
+  while (queued_ || busy_)
+    work_done_.wait(lock);
+}
+
+BlockingPool::Stats BlockingPool::stats() const {
+  ScopedLock lock(lock_);
+  Stats stats;
+  stats.threads = workers_.size();
+  stats.idle_threads = idle_;
+  stats.queued = queued_;
+  stats.completed = completed_;
+  stats.rejected = rejected_;
+  return stats;
+}
+
+bool BlockingPool::Push(Category category, Task&& task) {
+  DCHECK(category >= 0 && category < kCategories);
+  std::vector<std::thread> exited;
+  {
+    ScopedLock lock(lock_);
+    if (queued_ >= options_.max_queued) {
+      rejected_++;
+      DLOG(WARNING) << "Too many blocking tasks queued";
+      return false;
+    }
+    task.sequence = next_sequence_++;
+    queues_[category].push_back(std::move(task));
+    queued_++;
+
+    // The idle workers have been woken up for the tasks they can run already;
+    // start another thread if this one would be left waiting.
+    if (Runnable() > starting_ + idle_ &&
+        workers_.size() < options_.max_threads)
+      StartThread();
+    else if (idle_)
+      work_posted_.notify_one();
+    exited.swap(exited_);
+  }
+  for (std::thread& thread: exited)
+    thread.join();
+  return true;
+}
+
+size_t BlockingPool::Runnable() const {
+  size_t runnable = 0;
+  for (int i = 0; i < kCategories; ++i) {
+    size_t limit = options_.category_limits[i];
+    if (running_[i] < limit)
+      runnable += std::min(queues_[i].size(), limit - running_[i]);
+  }
+  return runnable;
+}
+
+bool BlockingPool::TakeTask(Task* task, Category* category) {
+  int best = -1;
+  for (int i = 0; i < kCategories; ++i) {
+    if (queues_[i].empty() || running_[i] >= options_.category_limits[i])
+      continue;
+    if (best < 0 ||
+        queues_[i].front().sequence < queues_[best].front().sequence)
+      best = i;
+  }
+  if (best < 0)
+    return false;
+
+  *task = std::move(queues_[best].front());
+  queues_[best].pop_front();
+  queued_--;
+  busy_++;
+  running_[best]++;
+  *category = static_cast<Category>(best);
+  return true;
+}
+
+void BlockingPool::StartThread() {
+  // The new thread waits for |lock_| before using its iterator.
+  starting_++;
+  workers_.push_back(std::thread());
+  WorkerIterator self = --workers_.end();
+  *self = std::thread(Bind(&BlockingPool::RunWorker, this, self));
+}
+
+void BlockingPool::RunWorker(WorkerIterator self) {
+  std::unique_lock<Lock> lock(lock_);
+  starting_--;
+  for (;;) {
+    Task task;
+    Category category;
+    if (TakeTask(&task, &category)) {
+      lock.unlock();
+      task.callback();
+      if (task.reply)
+        task.reply_loop->Post(std::move(task.reply));
+      // Whatever the task holds is released outside of the lock.
+      task = Task();
+      lock.lock();
+
+      running_[category]--;
+      busy_--;
+      completed_++;
+      if (!queued_) {
+        if (!busy_)
+          work_done_.notify_all();
+        // Nothing is held back by its category's limit either, so the idle
+        // workers can exit.
+        if (quit_)
+          work_posted_.notify_all();
+      }
+      continue;
+    }
+
+    if (quit_ && !queued_)
+      break;
+    idle_++;
+    bool timed_out = work_posted_.wait_for(lock, options_.idle_timeout) ==
+                     std::cv_status::timeout;
+    idle_--;
+    if (timed_out && workers_.size() > options_.min_threads && !Runnable())
+      break;
+  }
+
+  exited_.push_back(std::move(*self));
+  workers_.erase(self);
+  work_done_.notify_all();
+}
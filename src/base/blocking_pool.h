@@ -0,0 +1,136 @@
+#ifndef BASE_BLOCKING_POOL_H
+#define BASE_BLOCKING_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+#include "base/lock.h"
+#include "base/memory.h"
+#include "base/time.h"
+
+class EventLoop;
+
+// Runs blocking calls, like getaddrinfo(3) or fsync(2), so that EventLoops
+// don't have to. Unlike a ThreadPool the workers spend most of their time
+// waiting, so there can be many more of them than CPUs.
+//
+// The pool starts a thread whenever a task could run but no worker is idle,
+// up to a maximum, and threads that stay idle for a while exit. Each task has
+// a Category, and each category has its own concurrency limit so that one
+// kind of slow call can't take all the threads; tasks beyond that limit wait
+// in the queue, which has a maximum size too. Tasks run in the order they
+// were posted, except for the ones held back by their category's limit.
+class BlockingPool {
+ public:
+  typedef std::function<void()> Callback;
+
+  enum Category {
+    GENERAL,
+    // getaddrinfo(3) and friends.
+    NAME_RESOLUTION,
+    // stat(2), fsync(2) and other calls that wait for the disk.
+    FILESYSTEM,
+    kCategories,
+  };
+
+  struct Options {
+    Options();
+
+    // The threads kept around while idle.
+    size_t min_threads;
+    size_t max_threads;
+    // Threads above |min_threads| exit after being idle this long.
+    TimeDelta idle_timeout;
+    // Post() fails once this many tasks are waiting for a thread.
+    size_t max_queued;
+    // The most tasks of each category that run at the same time.
+    size_t category_limits[kCategories];
+  };
+
+  struct Stats {
+    size_t threads;
+    size_t idle_threads;
+    // The tasks waiting for a thread.
+    size_t queued;
+    // The tasks that have run, and posted their replies.
+    uint64 completed;
+    // The tasks that Post() refused because the queue was full.
+    uint64 rejected;
+  };
+
+  static unique_ptr<BlockingPool> Create(const Options& options = Options());
+
+  // Returns a pool shared by the whole process, created with the default
+  // Options on first use. It's never deleted.
+  static BlockingPool* Shared();
+
+  // Waits until all the posted tasks have run.
+  ~BlockingPool();
+
+  // Runs |f| on one of the threads, and returns true. Returns false without
+  // taking |f| if the queue is full. Can be called from any thread.
+  bool Post(Category category, Callback&& f);
+
+  // Like Post(), and then posts |reply| to the EventLoop that was running when
+  // PostAndReply() was invoked.
+  bool PostAndReply(Category category, Callback&& f, Callback&& reply);
+
+  // Blocks until no tasks are queued or running. Their replies have been
+  // posted by then, but might not have run yet.
+  void WaitUntilIdle();
+
+  Stats stats() const;
+
+ private:
+  struct Task {
+    Callback callback;
+    EventLoop* reply_loop;
+    Callback reply;
+    uint64 sequence;
+  };
+  typedef std::list<std::thread>::iterator WorkerIterator;
+
+  explicit BlockingPool(const Options& options);
+
+  bool Push(Category category, Task&& task);
+  // The queued tasks that are within their category's limit. |lock_| must be
+  // held, as for the next two.
+  size_t Runnable() const;
+  // Takes the oldest of those tasks, if there is any.
+  bool TakeTask(Task* task, Category* category);
+  void StartThread();
+  void RunWorker(WorkerIterator self);
+
+  const Options options_;
+
+  mutable Lock lock_;
+  // Wakes up the idle workers.
+  std::condition_variable work_posted_;
+  // Wakes up WaitUntilIdle() and the destructor.
+  std::condition_variable work_done_;
+
+  std::deque<Task> queues_[kCategories];
+  size_t running_[kCategories];
+  size_t queued_;
+  size_t busy_;
+  uint64 next_sequence_;
+  uint64 completed_;
+  uint64 rejected_;
+
+  // Threads that exit move themselves to |exited_|, to be joined later.
+  std::list<std::thread> workers_;
+  std::vector<std::thread> exited_;
+  // The threads that haven't looked for a task yet count as idle too.
+  size_t starting_;
+  size_t idle_;
+  bool quit_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockingPool);
+};
+
+#endif  // BASE_BLOCKING_POOL_H
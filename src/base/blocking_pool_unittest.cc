@@ -0,0 +1,212 @@
+#include "base/blocking_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/lock.h"
+#include "base/unittest.h"
+
+namespace {
+
+// Blocks the tasks that wait on it until it's opened.
+class Gate {
+ public:
+  Gate() : open_(false), waiting_(0) {}
+
+  void Wait() {
+    std::unique_lock<Lock> lock(lock_);
+    waiting_++;
+    changed_.notify_all();
+    while (!open_)
+      changed_.wait(lock);
+    waiting_--;
+  }
+
+  void WaitForWaiters(int count) {
+    std::unique_lock<Lock> lock(lock_);
+    while (waiting_ < count)
+      changed_.wait(lock);
+  }
+
+  int waiting() {
+    ScopedLock lock(lock_);
+    return waiting_;
+  }
+
+  void Open() {
+    ScopedLock lock(lock_);
+    open_ = true;
+    changed_.notify_all();
+  }
+
+ private:
+  Lock lock_;
+  std::condition_variable changed_;
+  bool open_;
+  int waiting_;
+};
+
+void increment(std::atomic<int>* counter) {
+  (*counter)++;
+}
+
+void wait_and_increment(Gate* gate, std::atomic<int>* counter) {
+  gate->Wait();
+  (*counter)++;
+}
+
+void reply(EventLoop* loop, std::atomic<int>* counter, int* replies,
+           int expected) {
+  EXPECT_EQ(loop, EventLoop::Current());
+  EXPECT_LT(*replies, *counter);
+  if (++(*replies) == expected)
+    loop->QuitSoon();
+}
+
+BlockingPool::Options small_options() {
+  BlockingPool::Options options;
+  options.max_threads = 4;
+  options.idle_timeout = TimeDelta(10);
+  for (int i = 0; i < BlockingPool::kCategories; ++i)
+    options.category_limits[i] = 4;
+  return options;
+}
+
+}  // namespace
+
+TEST(BlockingPool, PostAndReply) {
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  ASSERT_TRUE(loop.get());
+  unique_ptr<BlockingPool> pool = BlockingPool::Create(small_options());
+  ASSERT_TRUE(pool.get());
+  std::atomic<int> counter(0);
+  int replies = 0;
+  loop->Post([&] {
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_TRUE(pool->PostAndReply(
+          BlockingPool::GENERAL, Bind(increment, &counter),
+          Bind(reply, loop.get(), &counter, &replies, 10)));
+    }
+  });
+  loop->Run();
+  EXPECT_EQ(10, counter);
+  EXPECT_EQ(10, replies);
+
+  // Deleting the pool waits for the tasks.
+  for (int i = 0; i < 100; ++i)
+    pool->Post(BlockingPool::GENERAL, Bind(increment, &counter));
+  pool.reset();
+  EXPECT_EQ(110, counter);
+}
+
+TEST(BlockingPool, GrowsAndShrinks) {
+  BlockingPool::Options options = small_options();
+  options.min_threads = 1;
+  unique_ptr<BlockingPool> pool = BlockingPool::Create(options);
+  EXPECT_EQ(0u, pool->stats().threads);
+
+  // A thread per blocked task, up to the maximum.
+  Gate gate;
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 6; ++i) {
+    EXPECT_TRUE(pool->Post(BlockingPool::GENERAL,
+                           Bind(wait_and_increment, &gate, &counter)));
+  }
+  gate.WaitForWaiters(4);
+  BlockingPool::Stats stats = pool->stats();
+  EXPECT_EQ(4u, stats.threads);
+  EXPECT_EQ(2u, stats.queued);
+
+  gate.Open();
+  pool->WaitUntilIdle();
+  EXPECT_EQ(6, counter);
+  EXPECT_EQ(0u, pool->stats().queued);
+
+  // The idle threads go away, except for |min_threads|.
+  while (pool->stats().threads > 1)
+    std::this_thread::sleep_for(TimeDelta(5));
+  std::this_thread::sleep_for(TimeDelta(30));
+  EXPECT_EQ(1u, pool->stats().threads);
+
+  // That one is reused.
+  pool->Post(BlockingPool::GENERAL, Bind(increment, &counter));
+  pool->WaitUntilIdle();
+  EXPECT_EQ(7, counter);
+  EXPECT_EQ(1u, pool->stats().threads);
+}
+
+TEST(BlockingPool, QueueLimit) {
+  BlockingPool::Options options = small_options();
+  options.max_threads = 1;
+  options.max_queued = 2;
+  unique_ptr<BlockingPool> pool = BlockingPool::Create(options);
+
+  Gate gate;
+  std::atomic<int> counter(0);
+  EXPECT_TRUE(pool->Post(BlockingPool::GENERAL,
+                         Bind(wait_and_increment, &gate, &counter)));
+  gate.WaitForWaiters(1);
+  EXPECT_TRUE(pool->Post(BlockingPool::GENERAL, Bind(increment, &counter)));
+  EXPECT_TRUE(pool->Post(BlockingPool::GENERAL, Bind(increment, &counter)));
+  EXPECT_FALSE(pool->Post(BlockingPool::GENERAL, Bind(increment, &counter)));
+  EXPECT_EQ(1u, pool->stats().rejected);
+
+  gate.Open();
+  pool->WaitUntilIdle();
+  EXPECT_EQ(3, counter);
+  EXPECT_EQ(3u, pool->stats().completed);
+  EXPECT_TRUE(pool->Post(BlockingPool::GENERAL, Bind(increment, &counter)));
+}
+
+TEST(BlockingPool, CategoryLimit) {
+  BlockingPool::Options options = small_options();
+  options.category_limits[BlockingPool::FILESYSTEM] = 2;
+  unique_ptr<BlockingPool> pool = BlockingPool::Create(options);
+
+  // Slow filesystem calls don't hold up the other categories.
+  Gate gate;
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 5; ++i) {
+    pool->Post(BlockingPool::FILESYSTEM,
+               Bind(wait_and_increment, &gate, &counter));
+  }
+  gate.WaitForWaiters(2);
+  EXPECT_EQ(2u, pool->stats().threads);
+  EXPECT_EQ(3u, pool->stats().queued);
+
+  Gate other_gate;
+  pool->Post(BlockingPool::NAME_RESOLUTION,
+             Bind(wait_and_increment, &other_gate, &counter));
+  other_gate.WaitForWaiters(1);
+  other_gate.Open();
+  while (counter != 1)
+    std::this_thread::yield();
+  EXPECT_EQ(2, gate.waiting());
+
+  gate.Open();
+  pool->WaitUntilIdle();
+  EXPECT_EQ(6, counter);
+}
+
+class BlockingPoolTest : public BaseTest {};
+
+TEST_F(BlockingPoolTest, RunAllPendingRunsLaterReplies) {
+  // Each reply posts another blocking task, starting from a task that is
+  // still pending on |loop_|.
+  int replies = 0;
+  std::function<void()> reply = [&] {
+    if (++replies < 3) {
+      EXPECT_TRUE(blocking_pool_->PostAndReply(
+          BlockingPool::GENERAL, [] {}, BlockingPool::Callback(reply)));
+    }
+  };
+  loop_->Post([&] {
+    EXPECT_TRUE(blocking_pool_->PostAndReply(
+        BlockingPool::GENERAL, [] {}, BlockingPool::Callback(reply)));
+  });
+  RunAllPending();
+  EXPECT_EQ(3, replies);
+}
@@ -0,0 +1,305 @@
+#ifndef BASE_CALLBACK_LIST_H
+#define BASE_CALLBACK_LIST_H
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+#include "base/memory.h"
+#include "base/thread_checker.h"
+#include "base/weak.h"
+
+template<typename Signature>
+class CallbackList;
+
+// A CallbackList notifies any number of subscribers of an event:
+//
+//   CallbackList<void(const Config&)> on_config_changed;
+//   on_config_changed.Add(&Server::Reconfigure, server->GetWeakPtr());
+//   on_config_changed.AddOnLoop(loop, Bind(&Log, "config changed"));
+//   ...
+//   on_config_changed.Notify(config);
+//
+// Subscribers are kept in a vector, in the order they were added, and
+// Notify() invokes them in that order with |Args| as lvalues. Subscribers can
+// add and remove subscribers, and even call Notify() again, while they are
+// being notified: removed subscribers aren't invoked anymore, and added ones
+// are only invoked by later calls to Notify().
+//
+// Subscribers added with a WeakPtr are skipped once it is invalidated, and are
+// removed the next time Notify() finds them invalid; there's no need to remove
+// them explicitly.
+//
+// Subscribers added with AddOnLoop() are invoked on their EventLoop instead,
+// with a copy of the arguments. Notify() posts a single task to each loop,
+// that invokes all the subscribers on that loop. Those subscribers are
+// released on whichever thread ends up dropping the last reference to them,
+// so their callables must be safe to delete on other threads; Callbacks are,
+// and binding a WeakPtr to them makes them skip objects that have gone away
+// once the task runs on the loop.
+//
+// A CallbackList must be used on the thread that created it, and must not be
+// deleted while it is notifying its subscribers.
+template<typename... Args>
+class CallbackList<void(Args...)> {
+ public:
+  typedef std::function<void(Args...)> Function;
+
+  // Identifies a subscriber, and can remove it. It's cheap to copy, and must
+  // not be used after its CallbackList is deleted.
+  class Subscription {
+   public:
+    Subscription() : list_(NULL), id_(0) {}
+
+    // Removes the subscriber, if it hasn't been removed already. Subscribers
+    // on other loops might still be invoked by tasks that Notify() posted
+    // before.
+    void Remove() {
+      if (list_)
+        list_->Remove(id_);
+      list_ = NULL;
+    }
+
+   private:
+    friend class CallbackList;
+
+    Subscription(CallbackList* list, uint64 id) : list_(list), id_(id) {}
+
+    CallbackList* list_;
+    uint64 id_;
+  };
+
+  CallbackList() : next_id_(1), notifying_(0), needs_compaction_(false) {}
+
+  ~CallbackList() {
+    DCHECK(!notifying_);
+  }
+
+  Subscription Add(Function f) {
+    return AddSubscriber(Subscriber(next_id_, std::move(f)));
+  }
+
+  // Adds a subscriber that invokes |method| on |object| until |object| is
+  // invalidated.
+  template<typename T, typename Method>
+  Subscription Add(Method method, const WeakPtr<T>& object) {
+    DCHECK(object.get());
+    Subscriber subscriber(next_id_, Bind(method, object.get()));
+    subscriber.flag.reset(new WeakFlag(object.GetWeakFlag()));
+    return AddSubscriber(std::move(subscriber));
+  }
+
+  Subscription AddOnLoop(EventLoop* loop, Function f) {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    DCHECK(loop);
+    auto it = std::find_if(remotes_.begin(), remotes_.end(),
+                           [loop](const Remote& r) { return r.loop == loop; });
+    if (it == remotes_.end())
+      it = remotes_.insert(remotes_.end(), Remote(loop));
+    // Tasks posted before might still be using the current subscribers, so
+    // they are never changed in place.
+    std::shared_ptr<Subscribers> subscribers =
+        std::make_shared<Subscribers>(*it->subscribers);
+    subscribers->push_back(Subscriber(next_id_, std::move(f)));
+    it->subscribers = subscribers;
+    return Subscription(this, next_id_++);
+  }
+
+  // Returns the number of subscribers, including the ones on other loops and
+  // the ones whose WeakPtr was invalidated since the last Notify().
+  size_t size() const {
+    size_t size = added_.size();
+    for (const Subscriber& subscriber: subscribers_) {
+      if (!subscriber.removed)
+        size++;
+    }
+    for (const Remote& remote: remotes_)
+      size += remote.subscribers->size();
+    return size;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  void Notify(Args... args) {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    // The posts don't run any subscribers, so |remotes_| can't change here.
+    for (const Remote& remote: remotes_)
+      remote.loop->Post(RemoteNotification(remote.subscribers, args...));
+
+    // |subscribers_| doesn't change while notifying, so references to the
+    // subscribers stay valid even if they add other subscribers; those go
+    // to |added_| instead. Nested calls invoke the same subscribers.
+    notifying_++;
+    for (Subscriber& subscriber: subscribers_) {
+      if (subscriber.removed)
+        continue;
+      if (subscriber.flag && !subscriber.flag->IsValid()) {
+        subscriber.removed = true;
+        needs_compaction_ = true;
+        continue;
+      }
+      subscriber.function(args...);
+    }
+    notifying_--;
+
+    if (notifying_ == 0) {
+      if (needs_compaction_) {
+        subscribers_.erase(
+            std::remove_if(subscribers_.begin(), subscribers_.end(),
+                           [](const Subscriber& s) { return s.removed; }),
+            subscribers_.end());
+        needs_compaction_ = false;
+      }
+      if (!added_.empty()) {
+        std::move(added_.begin(), added_.end(),
+                  std::back_inserter(subscribers_));
+        added_.clear();
+      }
+    }
+  }
+
+ private:
+  struct Subscriber {
+    Subscriber(uint64 subscriber_id, Function f)
+        : id(subscriber_id), removed(false), function(std::move(f)) {}
+
+    Subscriber(const Subscriber& other)
+        : id(other.id),
+          removed(other.removed),
+          flag(other.flag ? new WeakFlag(*other.flag) : NULL),
+          function(other.function) {}
+
+    Subscriber(Subscriber&& other) = default;
+    Subscriber& operator=(Subscriber&& other) = default;
+
+    // Subscribers are sorted by |id|.
+    bool operator<(uint64 other_id) const { return id < other_id; }
+
+    uint64 id;
+    bool removed;
+    // Set for subscribers added with a WeakPtr.
+    unique_ptr<WeakFlag> flag;
+    Function function;
+  };
+
+  typedef std::vector<Subscriber> Subscribers;
+
+  // The subscribers on another EventLoop. Notify() shares them with the
+  // tasks it posts.
+  struct Remote {
+    explicit Remote(EventLoop* target_loop)
+        : loop(target_loop), subscribers(std::make_shared<Subscribers>()) {}
+
+    EventLoop* loop;
+    std::shared_ptr<const Subscribers> subscribers;
+  };
+
+  // The task that Notify() posts to each Remote loop.
+  class RemoteNotification {
+   public:
+    RemoteNotification(const std::shared_ptr<const Subscribers>& subscribers,
+                       const Args&... args)
+        : subscribers_(subscribers), args_(args...) {}
+
+    void operator()() {
+      for (const Subscriber& subscriber: *subscribers_) {
+        internal::UnpackTuple<sizeof...(Args)>::unpack(subscriber.function,
+                                                        args_);
+      }
+    }
+
+   private:
+    std::shared_ptr<const Subscribers> subscribers_;
+    std::tuple<typename std::decay<Args>::type...> args_;
+  };
+
+  Subscription AddSubscriber(Subscriber&& subscriber) {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    if (notifying_)
+      added_.push_back(std::move(subscriber));
+    else
+      subscribers_.push_back(std::move(subscriber));
+    return Subscription(this, next_id_++);
+  }
+
+  void Remove(uint64 id) {
+#if !defined(NDEBUG)
+    DCHECK(checker_.Check());
+#endif
+    if (Erase(&added_, id))
+      return;
+    typename Subscribers::iterator it =
+        std::lower_bound(subscribers_.begin(), subscribers_.end(), id);
+    if (it != subscribers_.end() && it->id == id) {
+      if (notifying_) {
+        // It might be running; it's erased once the outermost Notify()
+        // returns.
+        it->removed = true;
+        needs_compaction_ = true;
+      } else {
+        subscribers_.erase(it);
+      }
+      return;
+    }
+    for (size_t i = 0; i < remotes_.size(); ++i) {
+      const Subscribers& current = *remotes_[i].subscribers;
+      if (Find(current, id) != current.end()) {
+        std::shared_ptr<Subscribers> subscribers =
+            std::make_shared<Subscribers>(*remotes_[i].subscribers);
+        Erase(subscribers.get(), id);
+        if (subscribers->empty())
+          remotes_.erase(remotes_.begin() + i);
+        else
+          remotes_[i].subscribers = subscribers;
+        return;
+      }
+    }
+  }
+
+  // Returns the subscriber with |id| in |subscribers|, or its end().
+  static typename Subscribers::const_iterator Find(
+      const Subscribers& subscribers, uint64 id) {
+    typename Subscribers::const_iterator it =
+        std::lower_bound(subscribers.begin(), subscribers.end(), id);
+    return it != subscribers.end() && it->id == id ? it : subscribers.end();
+  }
+
+  static bool Erase(Subscribers* subscribers, uint64 id) {
+    typename Subscribers::const_iterator it = Find(*subscribers, id);
+    if (it == subscribers->end())
+      return false;
+    subscribers->erase(it);
+    return true;
+  }
+
+#if !defined(NDEBUG)
+  ThreadChecker checker_;
+#endif
+  uint64 next_id_;
+  Subscribers subscribers_;
+  // Subscribers added while notifying, which are moved to |subscribers_|
+  // once the outermost Notify() returns.
+  Subscribers added_;
+  std::vector<Remote> remotes_;
+  int notifying_;
+  bool needs_compaction_;
+
+  DISALLOW_COPY_AND_ASSIGN(CallbackList);
+};
+
+#endif  // BASE_CALLBACK_LIST_H
@@ -0,0 +1,51 @@
+#include <functional>
+#include <vector>
+
+#include "base/callback_list.h"
+#include "base/weak.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+class Listener : public Weakling<Listener> {
+ public:
+  Listener() : events_(0) {}
+
+  void OnEvent(int value) { events_ += value; }
+
+  int events() const { return events_; }
+
+ private:
+  int events_;
+};
+
+// Notifies |state.range(0)| weak subscribers.
+void BM_NotifyCallbackList(benchmark::State& state) {
+  std::vector<Listener> listeners(state.range(0));
+  CallbackList<void(int)> list;
+  for (Listener& listener: listeners)
+    list.Add(&Listener::OnEvent, listener.GetWeakPtr());
+  for (auto _: state)
+    list.Notify(1);
+  benchmark::DoNotOptimize(listeners[0].events());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same, with a vector of Callbacks bound to WeakPtrs.
+void BM_NotifyVector(benchmark::State& state) {
+  std::vector<Listener> listeners(state.range(0));
+  std::vector<std::function<void(int)>> list;
+  for (Listener& listener: listeners)
+    list.push_back(Bind(&Listener::OnEvent, listener.GetWeakPtr()));
+  for (auto _: state) {
+    for (const std::function<void(int)>& f: list)
+      f(1);
+  }
+  benchmark::DoNotOptimize(listeners[0].events());
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+}  // namespace
+
+BENCHMARK(BM_NotifyCallbackList)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_NotifyVector)->Arg(1)->Arg(16)->Arg(256);
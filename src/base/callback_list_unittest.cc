@@ -0,0 +1,161 @@
+#include "base/callback_list.h"
+
+#include <string>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/unittest.h"
+#include "base/weak.h"
+
+namespace {
+
+typedef CallbackList<void(const std::string&)> StringList;
+
+void Append(std::string* out, const std::string& prefix,
+            const std::string& value) {
+  *out += prefix + value;
+}
+
+class Listener : public Weakling<Listener> {
+ public:
+  explicit Listener(std::string* out) : out_(out) {}
+
+  void OnEvent(const std::string& value) {
+    *out_ += value;
+  }
+
+ private:
+  std::string* out_;
+};
+
+// Adds and removes subscribers from within a notification.
+class Mutator {
+ public:
+  Mutator(StringList* list, std::string* out) : list_(list), out_(out) {}
+
+  void set_victim(StringList::Subscription victim) { victim_ = victim; }
+
+  void OnEvent(const std::string& value) {
+    *out_ += "m";
+    victim_.Remove();
+    list_->Add(Bind(Append, out_, "+"));
+  }
+
+ private:
+  StringList* list_;
+  std::string* out_;
+  StringList::Subscription victim_;
+};
+
+// Notifies again from within a notification, once.
+void Reenter(StringList* list, bool* reentered, const std::string& value) {
+  if (*reentered)
+    return;
+  *reentered = true;
+  list->Notify(value + value);
+}
+
+void RecordLoop(EventLoop* expected, bool* on_loop, int* count, int value) {
+  *on_loop = EventLoop::Current() == expected;
+  *count += value;
+}
+
+void QuitLoop(EventLoop* loop, int value) {
+  loop->QuitSoon();
+}
+
+class CallbackListTest : public TwoLoopTest {};
+
+}  // namespace
+
+TEST(CallbackList, Notify) {
+  std::string out;
+  StringList list;
+  EXPECT_TRUE(list.empty());
+  list.Notify("x");
+
+  list.Add(Bind(Append, &out, "a"));
+  StringList::Subscription b = list.Add(Bind(Append, &out, "b"));
+  list.Add(Bind(Append, &out, "c"));
+  EXPECT_EQ(3u, list.size());
+  list.Notify("1");
+  EXPECT_EQ("a1b1c1", out);
+
+  out.clear();
+  b.Remove();
+  b.Remove();
+  EXPECT_EQ(2u, list.size());
+  list.Notify("2");
+  EXPECT_EQ("a2c2", out);
+}
+
+TEST(CallbackList, Weak) {
+  std::string out;
+  StringList list;
+  Listener first(&out);
+  unique_ptr<Listener> second(new Listener(&out));
+  list.Add(&Listener::OnEvent, first.GetWeakPtr());
+  list.Add(&Listener::OnEvent, second->GetWeakPtr());
+  list.Notify("a");
+  EXPECT_EQ("aa", out);
+
+  // Invalidated subscribers are skipped, and pruned when notifying.
+  second.reset();
+  EXPECT_EQ(2u, list.size());
+  list.Notify("b");
+  EXPECT_EQ("aab", out);
+  EXPECT_EQ(1u, list.size());
+}
+
+TEST(CallbackList, Reentrancy) {
+  std::string out;
+  StringList list;
+  Mutator mutator(&list, &out);
+  list.Add(Bind(&Mutator::OnEvent, &mutator));
+  mutator.set_victim(list.Add(Bind(Append, &out, "v")));
+  list.Add(Bind(Append, &out, "z"));
+
+  // The victim is removed before its turn, and the added subscriber only
+  // runs on the next notification.
+  list.Notify("1");
+  EXPECT_EQ("mz1", out);
+  EXPECT_EQ(3u, list.size());
+
+  out.clear();
+  mutator.set_victim(StringList::Subscription());
+  list.Notify("2");
+  EXPECT_EQ("mz2+2", out);
+  EXPECT_EQ(4u, list.size());
+
+  // A subscriber can notify again; the nested call runs every subscriber.
+  StringList nested;
+  bool reentered = false;
+  out.clear();
+  nested.Add(Bind(Append, &out, "a"));
+  nested.Add(Bind(Reenter, &nested, &reentered));
+  nested.Add(Bind(Append, &out, "b"));
+  nested.Notify("1");
+  EXPECT_EQ("a1a11b11b1", out);
+}
+
+TEST_F(CallbackListTest, OnLoop) {
+  CallbackList<void(int)> list;
+  bool on_loop = false;
+  int count = 0;
+  list.AddOnLoop(other_.get(), Bind(RecordLoop, other_.get(), &on_loop,
+                                    &count));
+  CallbackList<void(int)>::Subscription removed =
+      list.AddOnLoop(other_.get(), Bind(RecordLoop, loop_.get(), &on_loop,
+                                        &count));
+  // Invoked after the subscribers on |other_|, in the same task.
+  list.AddOnLoop(other_.get(), Bind(QuitLoop, loop_.get()));
+  EXPECT_EQ(3u, list.size());
+  removed.Remove();
+  EXPECT_EQ(2u, list.size());
+
+  list.Notify(5);
+  EXPECT_EQ(0, count);
+  EXPECT_TRUE(Run());
+  EXPECT_TRUE(on_loop);
+  EXPECT_EQ(5, count);
+}
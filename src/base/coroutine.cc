@@ -0,0 +1,56 @@
+#include "base/coroutine.h"
+
+#if defined(BASE_HAS_COROUTINES)
+
+#include <new>
+
+#include "base/slab_allocator.h"
+
+namespace {
+
+// Frames of up to 128 << i bytes come from the pool i.
+const int kPools = 6;
+const size_t kSmallestPool = 128;
+
+SlabAllocator* pool(int index) {
+  // These are never deleted, since frames can outlive static destructors.
+  static SlabAllocator* pools[kPools] = {
+    new SlabAllocator(kSmallestPool),
+    new SlabAllocator(kSmallestPool << 1),
+    new SlabAllocator(kSmallestPool << 2),
+    new SlabAllocator(kSmallestPool << 3),
+    new SlabAllocator(kSmallestPool << 4),
+    new SlabAllocator(kSmallestPool << 5),
+  };
+  return pools[index];
+}
+
+// Returns the pool for frames of |size| bytes, or -1.
+int pool_index(size_t size) {
+  for (int i = 0; i < kPools; ++i) {
+    if (size <= kSmallestPool << i)
+      return i;
+  }
+  return -1;
+}
+
+}  // namespace
+
+namespace internal {
+
+void* AllocateCoroutineFrame(size_t size) {
+  int index = pool_index(size);
+  return index == -1 ? ::operator new(size) : pool(index)->Allocate();
+}
+
+void FreeCoroutineFrame(void* frame, size_t size) {
+  int index = pool_index(size);
+  if (index == -1)
+    ::operator delete(frame);
+  else
+    pool(index)->Free(frame);
+}
+
+}  // namespace internal
+
+#endif  // BASE_HAS_COROUTINES
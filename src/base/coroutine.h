@@ -0,0 +1,273 @@
+#ifndef BASE_COROUTINE_H
+#define BASE_COROUTINE_H
+
+// Lets coroutines wait for descriptors, timers, other loops and DNS replies
+// without writing callbacks:
+//
+//   Coroutine Echo(int fd) {
+//     for (;;) {
+//       PollResult ready = co_await ReadReady(fd);
+//       if (ready.nval || ready.hup)
+//         co_return;
+//       ...
+//     }
+//   }
+//
+// This needs a compiler with C++20 coroutines (waf configure --coroutines);
+// with the default flags this header declares nothing.
+
+#if defined(__cpp_impl_coroutine)
+
+#define BASE_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "base/base.h"
+#include "base/dns.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+#include "base/time.h"
+
+namespace internal {
+
+// Coroutine frames come from pools of a few size classes, which don't call
+// malloc once they have grown. Larger frames use operator new.
+void* AllocateCoroutineFrame(size_t size);
+void FreeCoroutineFrame(void* frame, size_t size);
+
+struct PooledPromise {
+  static void* operator new(size_t size) {
+    return AllocateCoroutineFrame(size);
+  }
+
+  static void operator delete(void* frame, size_t size) {
+    FreeCoroutineFrame(frame, size);
+  }
+
+  void unhandled_exception() {
+    LOG(FATAL) << "unhandled exception in a coroutine";
+  }
+};
+
+// Resumes the coroutine waiting for a Task once the Task finishes.
+template<typename Promise>
+struct ResumeContinuation {
+  bool await_ready() noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> handle) noexcept {
+    return handle.promise().continuation;
+  }
+
+  void await_resume() noexcept {}
+};
+
+template<typename T>
+struct TaskPromiseBase : public PooledPromise {
+  template<typename U>
+  void return_value(U&& value) {
+    result.emplace(std::forward<U>(value));
+  }
+
+  T TakeResult() {
+    return std::move(*result);
+  }
+
+  std::optional<T> result;
+};
+
+template<>
+struct TaskPromiseBase<void> : public PooledPromise {
+  void return_void() {}
+  void TakeResult() {}
+};
+
+}  // namespace internal
+
+// The return type of coroutines that run on their own. They start right away
+// on the calling thread, and their frame is released when they finish;
+// nothing can wait for them.
+//
+// A coroutine that is still waiting when its EventLoop is deleted is never
+// resumed, and its frame is leaked.
+class Coroutine {
+ public:
+  struct promise_type : public internal::PooledPromise {
+    Coroutine get_return_object() { return Coroutine(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+  };
+};
+
+// The return type of coroutines that produce a T, possibly move-only, for
+// another coroutine. A Task starts when it is co_awaited, and resumes the
+// awaiting coroutine when it finishes.
+template<typename T>
+class Task {
+ public:
+  struct promise_type : public internal::TaskPromiseBase<T> {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    internal::ResumeContinuation<promise_type> final_suspend() noexcept {
+      return {};
+    }
+
+    std::coroutine_handle<> continuation;
+  };
+
+  Task(Task&& other) : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+
+  ~Task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  bool await_ready() { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+
+  T await_resume() { return handle_.promise().TakeResult(); }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(Task);
+};
+
+// The readiness flags that the PollCallback of an EventLoop receives.
+struct PollResult {
+  bool nval;
+  bool hup;
+  bool err;
+};
+
+// co_await ReadReady(fd) suspends until |fd| is readable on the current
+// EventLoop, like PostWhenReadReady().
+class ReadReady {
+ public:
+  explicit ReadReady(int fd) : fd_(fd), result_() {}
+
+  bool await_ready() { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    // Captures fit in the std::function without allocating.
+    EventLoop::Current()->PostWhenReadReady(
+        fd_, [this, handle](bool nval, bool hup, bool err) {
+          result_ = { nval, hup, err };
+          handle.resume();
+        });
+  }
+
+  PollResult await_resume() { return result_; }
+
+ private:
+  int fd_;
+  PollResult result_;
+};
+
+// co_await WriteReady(fd) suspends until |fd| is writable on the current
+// EventLoop, like PostWhenWriteReady().
+class WriteReady {
+ public:
+  explicit WriteReady(int fd) : fd_(fd), result_() {}
+
+  bool await_ready() { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    EventLoop::Current()->PostWhenWriteReady(
+        fd_, [this, handle](bool nval, bool hup, bool err) {
+          result_ = { nval, hup, err };
+          handle.resume();
+        });
+  }
+
+  PollResult await_resume() { return result_; }
+
+ private:
+  int fd_;
+  PollResult result_;
+};
+
+// co_await SleepFor(delay) resumes on the current EventLoop after |delay|,
+// like PostAfter().
+class SleepFor {
+ public:
+  explicit SleepFor(const PreciseTimeDelta& delay) : delay_(delay) {}
+
+  bool await_ready() { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    EventLoop::Current()->PostAfter([handle] { handle.resume(); }, delay_);
+  }
+
+  void await_resume() {}
+
+ private:
+  PreciseTimeDelta delay_;
+};
+
+// co_await SwitchTo(loop) resumes on |loop|, unless that's the current one
+// already. The coroutine then runs on the thread of |loop|.
+class SwitchTo {
+ public:
+  explicit SwitchTo(EventLoop* loop,
+                    EventLoop::Priority priority = EventLoop::NORMAL)
+      : loop_(loop), priority_(priority) {}
+
+  bool await_ready() { return loop_->IsCurrent(); }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    loop_->Post([handle] { handle.resume(); }, priority_);
+  }
+
+  void await_resume() {}
+
+ private:
+  EventLoop* loop_;
+  EventLoop::Priority priority_;
+};
+
+// co_await Resolve(dns, host, service) returns the addrinfo that
+// DNS::Resolve() replies with, or NULL. The coroutine resumes on the current
+// EventLoop.
+class Resolve {
+ public:
+  Resolve(DNS* dns, const std::string& host, const std::string& service)
+      : dns_(dns), host_(host), service_(service) {}
+
+  bool await_ready() { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    dns_->Resolve(host_, service_,
+                  [this, handle](DNS::unique_addrinfo addr) {
+                    result_ = std::move(addr);
+                    handle.resume();
+                  });
+  }
+
+  DNS::unique_addrinfo await_resume() { return std::move(result_); }
+
+ private:
+  DNS* dns_;
+  std::string host_;
+  std::string service_;
+  DNS::unique_addrinfo result_;
+};
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // BASE_COROUTINE_H
@@ -0,0 +1,108 @@
+#include "base/coroutine.h"
+
+#if defined(BASE_HAS_COROUTINES)
+
+#include <string>
+#include <thread>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "base/bind.h"
+#include "base/memory.h"
+#include "base/unittest.h"
+
+namespace {
+
+Task<int> Add(int a, int b) {
+  co_return a + b;
+}
+
+Task<unique_ptr<std::string>> MakeString(const char* value) {
+  co_await SleepFor(TimeDelta(1));
+  co_return make_unique(new std::string(value));
+}
+
+Coroutine UseTasks(std::string* result) {
+  int sum = co_await Add(1, 2);
+  unique_ptr<std::string> string = co_await MakeString("abc");
+  *result = *string + std::to_string(sum);
+  EventLoop::Current()->QuitSoon();
+}
+
+Coroutine ReadAll(int fd, std::string* result) {
+  for (;;) {
+    PollResult ready = co_await ReadReady(fd);
+    EXPECT_FALSE(ready.nval);
+    char buffer[16];
+    int size = read(fd, buffer, sizeof(buffer));
+    if (size <= 0)
+      break;
+    result->append(buffer, size);
+  }
+  EventLoop::Current()->QuitSoon();
+}
+
+Coroutine WriteBytes(int fd, const char* bytes) {
+  PollResult ready = co_await WriteReady(fd);
+  EXPECT_FALSE(ready.err);
+  EXPECT_EQ((ssize_t) strlen(bytes), write(fd, bytes, strlen(bytes)));
+  close(fd);
+}
+
+Coroutine HopBetween(EventLoop* main, EventLoop* other,
+                     std::thread::id* other_id) {
+  co_await SwitchTo(other);
+  EXPECT_TRUE(other->IsCurrent());
+  *other_id = std::this_thread::get_id();
+  co_await SwitchTo(main);
+  EXPECT_TRUE(main->IsCurrent());
+  main->QuitSoon();
+}
+
+Coroutine ResolveLocalhost(DNS* dns, std::string* port) {
+  DNS::unique_addrinfo addr = co_await Resolve(dns, "127.0.0.1", "8080");
+  if (addr)
+    *port = DNS::GetPort(*addr);
+  EventLoop::Current()->QuitSoon();
+}
+
+}  // namespace
+
+class CoroutineTest : public TwoLoopTest {};
+
+TEST_F(CoroutineTest, Tasks) {
+  std::string result;
+  loop_->Post(Bind(UseTasks, &result));
+  EXPECT_TRUE(Run());
+  EXPECT_EQ("abc3", result);
+}
+
+TEST_F(CoroutineTest, Readiness) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::string result;
+  loop_->Post([&] {
+    ReadAll(fds[0], &result);
+    WriteBytes(fds[1], "hello");
+  });
+  EXPECT_TRUE(Run());
+  EXPECT_EQ("hello", result);
+  close(fds[0]);
+}
+
+TEST_F(CoroutineTest, SwitchTo) {
+  std::thread::id other_id;
+  loop_->Post(Bind(HopBetween, loop_.get(), other_.get(), &other_id));
+  EXPECT_TRUE(Run());
+  EXPECT_NE(std::this_thread::get_id(), other_id);
+}
+
+TEST_F(CoroutineTest, Resolve) {
+  std::string port;
+  loop_->Post(Bind(ResolveLocalhost, dns_.get(), &port));
+  EXPECT_TRUE(Run());
+  EXPECT_EQ("8080", port);
+}
+
+#endif  // BASE_HAS_COROUTINES
@@ -6,29 +6,24 @@
 #include <string.h>
 
 #include "base/bind.h"
+#include "base/blocking_pool.h"
 #include "base/event_loop.h"
 #include "base/logging.h"
 
 namespace {
 
-void Jump(const DNS::Callback& callback, addrinfo* ptr) {
-  DNS::unique_addrinfo unique(ptr);
-  callback(std::move(unique));
+void Jump(const DNS::Callback& callback,
+          const std::shared_ptr<DNS::unique_addrinfo>& result) {
+  callback(std::move(*result));
 }
 
 }  // namespace
 
-unique_ptr<DNS> DNS::Create() {
-  unique_ptr<EventLoop> loop(EventLoop::Create());
-  if (!loop.get())
-    return NULL;
-  return make_unique(new DNS(loop.release()));
+unique_ptr<DNS> DNS::Create(BlockingPool* pool) {
+  return make_unique(new DNS(pool ? pool : BlockingPool::Shared()));
 }
 
-DNS::~DNS() {
-  dns_loop_->QuitSoon();
-  dns_thread_.join();
-}
+DNS::~DNS() {}
 
 void DNS::Resolve(const std::string& host,
                   const std::string& service,
@@ -37,8 +32,17 @@ void DNS::Resolve(const std::string& host,
                   int socktype,
                   int protocol) {
   DCHECK(EventLoop::Current());
-  dns_loop_->Post(Bind(&DNS::ResolveAndReply, this, host, service, callback,
-                       family, socktype, protocol, EventLoop::Current()));
+  // The task and the reply share the result, which is freed with them even if
+  // the reply never runs.
+  std::shared_ptr<unique_addrinfo> result =
+      std::make_shared<unique_addrinfo>();
+  if (!pool_->PostAndReply(BlockingPool::NAME_RESOLUTION,
+                           Bind(&DNS::ResolveBlocking, host, service, family,
+                                socktype, protocol, result),
+                           Bind(Jump, callback, result))) {
+    DLOG(ERROR) << "Can't resolve " << host << ":" << service;
+    EventLoop::Current()->Post(Bind(Jump, callback, result));
+  }
 }
 
 // static
@@ -107,13 +111,13 @@ std::string DNS::ToString(const addrinfo& addr) {
   return ss.str();
 }
 
-void DNS::ResolveAndReply(const std::string& host,
+// static
+void DNS::ResolveBlocking(const std::string& host,
                           const std::string& service,
-                          const Callback& callback,
                           int family,
                           int socktype,
                           int protocol,
-                          EventLoop* origin_loop) {
+                          const std::shared_ptr<unique_addrinfo>& result) {
   addrinfo hints;
   memset(&hints, 0, sizeof(hints));
   hints.ai_flags = 0;  // AI_ADDRCONFIG, AI_NUMERICHOST, AI_NUMERICSERV?
@@ -121,14 +125,13 @@ void DNS::ResolveAndReply(const std::string& host,
   hints.ai_socktype = socktype;
   hints.ai_protocol = protocol;
 
-  addrinfo* result;
+  addrinfo* list = NULL;
   if (getaddrinfo(host.empty() ? NULL : host.c_str(), service.c_str(),
-                  &hints, &result) != 0) {
+                  &hints, &list) != 0) {
     DLOGE(ERROR) << "getaddrinfo failed for " << host << ":" << service;
-    result = NULL;
+    return;
   }
-
-  origin_loop->Post(Bind(Jump, callback, result));
+  result->reset(list);
 }
 
 // static
@@ -136,6 +139,5 @@ void DNS::delete_addrinfo(addrinfo* addr) {
   freeaddrinfo(addr);
 }
 
-DNS::DNS(EventLoop* loop)
-    : dns_loop_(loop),
-      dns_thread_(Bind(&EventLoop::Run, loop)) {}
+DNS::DNS(BlockingPool* pool)
+    : pool_(pool) {}
@@ -2,7 +2,7 @@
 #define BASE_DNS_H
 
 #include <functional>
-#include <thread>
+#include <memory>
 
 #include <netdb.h>
 #include <sys/socket.h>
@@ -11,11 +11,10 @@
 #include "base/base.h"
 #include "base/memory.h"
 
-class EventLoop;
+class BlockingPool;
 
-// Objects of this class have their own EventLoop and thread to resolve DNS
-// without blocking the caller. This is handy because getaddrinfo(3) is a
-// blocking call.
+// Resolves DNS on a BlockingPool, without blocking the caller. This is handy
+// because getaddrinfo(3) is a blocking call.
 class DNS {
  public:
   struct addrinfo_deleter {
@@ -27,19 +26,21 @@ class DNS {
   typedef unique_ptr<addrinfo, addrinfo_deleter> unique_addrinfo;
   typedef std::function<void(unique_addrinfo)> Callback;
 
-  // Creates a new DNS object and returns it, or NULL if it fails. The DNS
-  // object has its own thread where resolutions are performed.
-  static unique_ptr<DNS> Create();
+  // Creates a new DNS object and returns it, or NULL if it fails. The
+  // resolutions are performed on |pool|, or on BlockingPool::Shared() if it's
+  // NULL.
+  static unique_ptr<DNS> Create(BlockingPool* pool = NULL);
 
-  // Waits until all pending resolutions are completed before returning.
+  // Pending resolutions still reply after the DNS object is deleted.
   ~DNS();
 
-  EventLoop* loop() { return dns_loop_.get(); }
+  BlockingPool* pool() { return pool_; }
 
   // Resolves |host| and |service|, and replies by invoking |callback| on the
   // current EventLoop. The argument to |callback| is the resolved addrinfo
-  // (see getaddrinfo(3)), or NULL. |host| and |service| can either be a name
-  // to resolve or a numeric value.
+  // (see getaddrinfo(3)), or NULL; it's NULL right away too if the pool has
+  // too many tasks queued. |host| and |service| can either be a name to
+  // resolve or a numeric value.
   void Resolve(const std::string& host,
                const std::string& service,
                const Callback& callback,
@@ -52,20 +53,18 @@ class DNS {
   static std::string ToString(const addrinfo& addr);
 
  private:
-  void ResolveAndReply(const std::string& host,
-                       const std::string& service,
-                       const Callback& callback,
-                       int family,
-                       int socktype,
-                       int protocol,
-                       EventLoop* origin_loop);
+  static void ResolveBlocking(const std::string& host,
+                              const std::string& service,
+                              int family,
+                              int socktype,
+                              int protocol,
+                              const std::shared_ptr<unique_addrinfo>& result);
 
   static void delete_addrinfo(addrinfo* addr);
 
-  explicit DNS(EventLoop* loop);
+  explicit DNS(BlockingPool* pool);
 
-  unique_ptr<EventLoop> dns_loop_;
-  std::thread dns_thread_;
+  BlockingPool* pool_;
 
   DISALLOW_COPY_AND_ASSIGN(DNS);
 };
@@ -1,196 +1,432 @@
 #include "base/event_loop.h"
 
-#include <unordered_map>
 #include <utility>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
-#include <pthread.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
 #include "base/lock.h"
 #include "base/logging.h"
 
 namespace {
 
-// TODO: Redo this using thread_local once clang++ supports it.
-pthread_once_t current_key_once = PTHREAD_ONCE_INIT;
-pthread_key_t current_key;
+// Returns the ticks used for the timers of a loop, which are microseconds,
+// rounding up.
+uint64 ticks_after(const Time& time) {
+  std::chrono::microseconds::rep us = std::chrono::duration_cast<
+      std::chrono::microseconds>(time.time_since_epoch()).count();
+  if (us < 0)
+    return 0;
+  if (std::chrono::microseconds(us) < time.time_since_epoch())
+    us++;
+  return us;
+}
 
-void create_current_key() {
-  int ret;
-  if ((ret = pthread_key_create(&current_key, NULL)) != 0)
-    DLOG(FATAL) << "pthread_key_create failed: " << ret;
+// Returns the ticks used for the timers of a loop, rounding down.
+uint64 ticks_before(const Time& time) {
+  std::chrono::microseconds::rep us = std::chrono::duration_cast<
+      std::chrono::microseconds>(time.time_since_epoch()).count();
+  return us < 0 ? 0 : us;
 }
 
-bool current_key_is_valid() {
-  int ret;
-  if ((ret = pthread_once(&current_key_once, create_current_key)) != 0) {
-    DLOG(FATAL) << "pthread_once failed: " << ret;
+// Tells the CPU that this is a spin-wait loop.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// The data registered with the Poller for |fd|. NULL is the wakeup descriptor.
+void* fd_to_data(int fd) {
+  return reinterpret_cast<void*>(static_cast<intptr_t>(fd) + 1);
+}
+
+int data_to_fd(void* data) {
+  return static_cast<int>(reinterpret_cast<intptr_t>(data) - 1);
+}
+
+#if !defined(__linux__)
+bool set_non_blocking_and_close_on_exec(int fd) {
+  return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) != -1 &&
+         fcntl(fd, F_SETFD, fcntl(fd, F_GETFD, 0) | FD_CLOEXEC) != -1;
+}
+#endif
+
+// Counts the tasks posted by this thread, to any loop, for take_sample().
+thread_local uint32 g_post_samples = 0;
+
+// Returns true once every |interval| calls with the same |count|, and never if
+// |interval| is zero.
+inline bool take_sample(uint32 interval, uint32* count) {
+  if (!interval || ++*count < interval)
+    return false;
+  *count = 0;
+  return true;
+}
+
+// Performs |op| right away, returning what Poller::Submit() would report.
+int perform_operation(Poller::Operation op, int fd, void* buffer,
+                      size_t size) {
+  ssize_t ret = -1;
+  switch (op) {
+    case Poller::READ:
+      ret = read(fd, buffer, size);
+      break;
+    case Poller::WRITE:
+      ret = write(fd, buffer, size);
+      break;
+    case Poller::ACCEPT:
+#if defined(__linux__)
+      ret = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+      ret = accept(fd, NULL, NULL);
+      if (ret != -1 && !set_non_blocking_and_close_on_exec(ret)) {
+        int error = errno;
+        close(ret);
+        errno = error;
+        ret = -1;
+      }
+#endif
+      break;
+  }
+  if (ret == -1)
+    return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+  return static_cast<int>(ret);
+}
+
+// Creates the descriptors used to wake up a loop. On linux that's a single
+// eventfd, which never blocks the writer and only needs one descriptor.
+bool create_wakeup_descriptors(int* read_fd, int* write_fd) {
+#if defined(__linux__)
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd == -1) {
+    DLOGE(ERROR) << "eventfd failed";
     return false;
   }
+  *read_fd = fd;
+  *write_fd = fd;
+#else
+  int fds[2];
+  if (pipe(fds) != 0) {
+    DLOGE(ERROR) << "pipe failed";
+    return false;
+  }
+  if (!set_non_blocking_and_close_on_exec(fds[0]) ||
+      !set_non_blocking_and_close_on_exec(fds[1])) {
+    DLOGE(ERROR) << "fcntl failed";
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  *read_fd = fds[0];
+  *write_fd = fds[1];
+#endif
   return true;
 }
 
 }  // namespace
 
 struct EventLoop::Task {
-  explicit Task(Callback&& f)
-      : callback(std::forward<Callback>(f)) {}
+  Task(Callback&& f, Priority priority)
+      : next(NULL),
+        priority(priority),
+        ready_time(0),
+        delayed(NULL),
+        callback(std::forward<Callback>(f)) {}
 
-  Task(Callback&& f, Callback&& reply)
-      : callback(std::forward<Callback>(f)),
+  Task(Callback&& f, Callback&& reply, Priority priority)
+      : next(NULL),
+        priority(priority),
+        ready_time(0),
+        delayed(NULL),
+        callback(std::forward<Callback>(f)),
         reply_loop(EventLoop::Current()),
         reply(std::forward<Callback>(reply)) {
     DCHECK(reply_loop);
   }
 
+  // Links the Task in |pending_|, or in its Lane.
+  Task* next;
+  Priority priority;
+  // When it was posted, or became due, if its latency is sampled; zero
+  // otherwise.
+  uint64 ready_time;
+  // The DelayedTask of tasks posted with PostAfter(), which is released with
+  // the Task.
+  DelayedTask* delayed;
   Callback callback;
   EventLoop* reply_loop;
   Callback reply;
 };
 
 struct EventLoop::PollTask {
-  PollTask(PollCallback&& f, int fd, int events)
-      : callback(std::forward<PollCallback>(f)), fd(fd), events(events) {}
+  PollTask(PollCallback&& f, int fd, int events, uint64 watch_id)
+      : callback(std::forward<PollCallback>(f)),
+        fd(fd),
+        events(events),
+        watch_id(watch_id) {}
 
   PollCallback callback;
   int fd;
+  // Zero for tasks that cancel |fd| or stop a watcher, or that were released
+  // while dispatching.
   int events;
+  // Zero for tasks that only run once.
+  uint64 watch_id;
 };
 
-struct EventLoop::DelayedTask {
-  DelayedTask(Task* task, Time when)
-      : task(task), when(when) {}
+struct EventLoop::IoTask {
+  IoTask(IoCallback&& f, Poller::Operation op, int fd, void* buffer,
+         size_t size)
+      : callback(std::forward<IoCallback>(f)),
+        op(op),
+        fd(fd),
+        buffer(buffer),
+        size(size),
+        prev(NULL),
+        next(NULL),
+        polling(false),
+        cancelled(false) {}
+
+  IoCallback callback;
+  Poller::Operation op;
+  int fd;
+  void* buffer;
+  size_t size;
+  // Links the IoTask in |io_tasks_|.
+  IoTask* prev;
+  IoTask* next;
+  // True while waiting for |fd| to be ready, instead of being in the kernel.
+  bool polling;
+  bool cancelled;
+};
+
+struct EventLoop::DelayedTask : public TimerWheel::Timer {
+  DelayedTask(Task* task, uint64 expiry, uint64 id)
+      : next(NULL), task(task), expiry(expiry) {
+    this->id.store(id, std::memory_order_relaxed);
+  }
 
+  // Links the DelayedTask in |pending_delayed_|.
+  DelayedTask* next;
   Task* task;
-  Time when;
-  bool operator<(const DelayedTask& t) const { return when > t.when; }
+  uint64 expiry;
+  // Zero once |task| starts running or is cancelled. TimerHandles keep
+  // pointing here after that, and the slab storage might be reused for
+  // another DelayedTask meanwhile, but ids are never reused.
+  std::atomic<uint64> id;
 };
 
+int EventLoop::FdState::events() const {
+  return (read ? POLLIN : 0) | (write ? POLLOUT : 0);
+}
+
 EventLoop::EventLoop()
-    : quit_soon_(false) {
+    : task_allocator_(sizeof(Task)),
+      poll_task_allocator_(sizeof(PollTask)),
+      delayed_task_allocator_(sizeof(DelayedTask)),
+      io_task_allocator_(sizeof(IoTask)),
+      pending_tasks_(0),
+      next_delayed_id_(1),
+      next_watch_id_(1),
+      has_pending_poll_(false),
+      spin_hits_(0),
+      starvation_ratio_(kDefaultStarvationRatio),
+      budget_tasks_(kDefaultFairnessBudget),
+      budget_time_(0),
+      tasks_since_poll_(0),
+      max_spin_(0),
+      idle_average_(0),
+      spin_misses_(0),
+      spin_window_(0),
+      task_sampling_interval_(kDefaultTaskSamplingInterval),
+      due_samples_(0),
+      run_samples_(0),
+      dispatching_(false),
+      io_tasks_(NULL),
+      wakeup_pending_(false),
+      quit_soon_(false) {
 #ifndef NDEBUG
   running_ = false;
 #endif
 }
 
 EventLoop::~EventLoop() {
-  close(pipe_read_);
-  close(pipe_write_);
-  if (!pending_.empty())
+  close(wakeup_read_);
+  if (wakeup_write_ != wakeup_read_)
+    close(wakeup_write_);
+  bool has_pending = false;
+  for (int i = 0; i < kPriorities; ++i) {
+    TakePending(i);
+    Task* task = lanes_[i].first;
+    has_pending = has_pending || task;
+    while (task) {
+      Task* next = task->next;
+      if (task->delayed)
+        DeleteDelayed(task->delayed);
+      task_allocator_.Delete(task);
+      task = next;
+    }
+  }
+  if (has_pending)
     DLOG(ERROR) << "Deleting EventLoop with pending_ tasks";
-  for (auto i: pending_) delete i;
-  while (!pending_delayed_.empty()) {
-    delete pending_delayed_.top().task;
-    pending_delayed_.pop();
+  InsertPendingDelayed();
+  std::vector<TimerWheel::Timer*> timers;
+  timers_.RemoveAll(&timers);
+  for (TimerWheel::Timer* timer: timers) {
+    DelayedTask* delayed = static_cast<DelayedTask*>(timer);
+    task_allocator_.Delete(delayed->task);
+    DeleteDelayed(delayed);
+  }
+  // Watchers stopped from other threads leave a task here, that is harmless.
+  bool has_pending_poll = false;
+  for (auto i: pending_poll_) {
+    if (i->events || !i->watch_id)
+      has_pending_poll = true;
+    poll_task_allocator_.Delete(i);
   }
-  if (!pending_poll_.empty())
+  for (const FdState& state: fd_states_) {
+    if (state.events())
+      has_pending_poll = true;
+    if (state.read) poll_task_allocator_.Delete(state.read);
+    if (state.write) poll_task_allocator_.Delete(state.write);
+  }
+  if (has_pending_poll)
     DLOG(ERROR) << "Deleting EventLoop with pending_poll_ tasks";
-  for (auto i: pending_poll_) delete i;
+  if (io_tasks_)
+    DLOG(ERROR) << "Deleting EventLoop with io_tasks_";
+  while (io_tasks_) {
+    IoTask* next = io_tasks_->next;
+    io_task_allocator_.Delete(io_tasks_);
+    io_tasks_ = next;
+  }
 }
 
 // static
-unique_ptr<EventLoop> EventLoop::Create() {
-  int fds[2];
-  if (pipe(fds) != 0) {
-    DLOGE(ERROR) << "pipe failed";
+unique_ptr<EventLoop> EventLoop::Create(Poller::Backend backend) {
+  unique_ptr<Poller> poller = Poller::Create(backend);
+  if (!poller)
     return NULL;
-  }
-  if (fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK) == -1) {
-    DLOGE(ERROR) << "fcntl failed";
-    close(fds[0]);
-    close(fds[1]);
+
+  int read_fd;
+  int write_fd;
+  if (!create_wakeup_descriptors(&read_fd, &write_fd))
     return NULL;
-  }
 
   unique_ptr<EventLoop> loop(new EventLoop);
-  loop->pipe_read_ = fds[0];
-  loop->pipe_write_ = fds[1];
+  loop->wakeup_read_ = read_fd;
+  loop->wakeup_write_ = write_fd;
+  // This is the only descriptor registered with NULL data.
+  poller->Add(loop->wakeup_read_, POLLIN, NULL);
+  loop->poller_ = std::move(poller);
   return loop;
 }
 
 // static
-EventLoop* EventLoop::Current() {
-  if (!current_key_is_valid())
-    return NULL;
-  return (EventLoop*) pthread_getspecific(current_key);
+thread_local EventLoop* EventLoop::current_ = NULL;
+
+void EventLoop::Post(Callback&& f, Priority priority) {
+  Task* task = task_allocator_.New<Task>(std::forward<Callback>(f), priority);
+  PushTasks(task, task, 1, priority);
 }
 
-void EventLoop::Post(Callback&& f) {
-  Task* task = new Task(std::forward<Callback>(f));
-  bool ping_pipe = false;
-  {
-    ScopedLock lock(pending_lock_);
-    ping_pipe = pending_.empty();
-    pending_.push_back(task);
-  }
-  if (ping_pipe)
-    PingPipe();
+void EventLoop::PostAndReply(Callback&& f, Callback&& r, Priority priority) {
+  Task* task = task_allocator_.New<Task>(
+      std::forward<Callback>(f), std::forward<Callback>(r), priority);
+  PushTasks(task, task, 1, priority);
 }
 
-void EventLoop::PostAndReply(Callback&& f, Callback&& r) {
-  Task* task = new Task(std::forward<Callback>(f), std::forward<Callback>(r));
-  bool ping_pipe = false;
-  {
-    ScopedLock lock(pending_lock_);
-    ping_pipe = pending_.empty();
-    pending_.push_back(task);
-  }
-  if (ping_pipe)
-    PingPipe();
+EventLoop::TimerHandle EventLoop::PostAfter(Callback&& f,
+                                            const PreciseTimeDelta& delay,
+                                            Priority priority) {
+  uint64 id = next_delayed_id_.fetch_add(1, std::memory_order_relaxed);
+  Task* task = task_allocator_.New<Task>(std::forward<Callback>(f), priority);
+  DelayedTask* delayed = delayed_task_allocator_.New<DelayedTask>(
+      task, ticks_after(Now() + delay), id);
+  task->delayed = delayed;
+  pending_delayed_.Push(delayed);
+  Wakeup();
+  return TimerHandle(this, delayed, id);
 }
 
-void EventLoop::PostAfter(Callback&& f, const TimeDelta& delay) {
-  Task* task = new Task(std::forward<Callback>(f));
-  Time when = Now() + delay;
-  bool ping_pipe = false;
-  {
-    ScopedLock lock(pending_lock_);
-    ping_pipe = pending_delayed_.empty() ||
-                pending_delayed_.top().when > when;
-    pending_delayed_.push(DelayedTask(task, when));
+void EventLoop::PostBatch(std::vector<Callback>&& tasks, Priority priority) {
+  Task* first = NULL;
+  Task* last = NULL;
+  size_t count = tasks.size();
+  for (Callback& f: tasks) {
+    Task* task = task_allocator_.New<Task>(std::move(f), priority);
+    if (last)
+      last->next = task;
+    else
+      first = task;
+    last = task;
   }
-  if (ping_pipe)
-    PingPipe();
+  tasks.clear();
+  if (first)
+    PushTasks(first, last, count, priority);
 }
 
 void EventLoop::PostWhenReadReady(int fd, PollCallback&& f) {
-  PollTask* task = new PollTask(std::forward<PollCallback>(f), fd, POLLIN);
-  {
-    ScopedLock lock(pending_lock_);
-    pending_poll_.push_back(task);
-  }
-  PingPipe();
+  AddPollTask(poll_task_allocator_.New<PollTask>(
+      std::forward<PollCallback>(f), fd, POLLIN, 0));
 }
 
 void EventLoop::PostWhenWriteReady(int fd, PollCallback&& f) {
-  PollTask* task = new PollTask(std::forward<PollCallback>(f), fd, POLLOUT);
-  {
-    ScopedLock lock(pending_lock_);
-    pending_poll_.push_back(task);
-  }
-  PingPipe();
+  AddPollTask(poll_task_allocator_.New<PollTask>(
+      std::forward<PollCallback>(f), fd, POLLOUT, 0));
+}
+
+EventLoop::WatchHandle EventLoop::WatchReadable(int fd, PollCallback&& f) {
+  uint64 id = next_watch_id_.fetch_add(1, std::memory_order_relaxed);
+  AddPollTask(poll_task_allocator_.New<PollTask>(
+      std::forward<PollCallback>(f), fd, POLLIN, id));
+  return WatchHandle(this, id);
+}
+
+EventLoop::WatchHandle EventLoop::WatchWritable(int fd, PollCallback&& f) {
+  uint64 id = next_watch_id_.fetch_add(1, std::memory_order_relaxed);
+  AddPollTask(poll_task_allocator_.New<PollTask>(
+      std::forward<PollCallback>(f), fd, POLLOUT, id));
+  return WatchHandle(this, id);
+}
+
+void EventLoop::PostRead(int fd, void* buffer, size_t size, IoCallback&& f) {
+  StartIo(io_task_allocator_.New<IoTask>(
+      std::forward<IoCallback>(f), Poller::READ, fd, buffer, size));
+}
+
+void EventLoop::PostWrite(int fd, const void* buffer, size_t size,
+                          IoCallback&& f) {
+  StartIo(io_task_allocator_.New<IoTask>(
+      std::forward<IoCallback>(f), Poller::WRITE, fd,
+      const_cast<void*>(buffer), size));
+}
+
+void EventLoop::PostAccept(int fd, IoCallback&& f) {
+  StartIo(io_task_allocator_.New<IoTask>(
+      std::forward<IoCallback>(f), Poller::ACCEPT, fd,
+      static_cast<void*>(NULL), 0));
 }
 
 void EventLoop::EventLoop::CancelDescriptor(int fd) {
   static PollCallback kEmptyFunction;
-  {
-    ScopedLock lock(pending_lock_);
-    pending_poll_.push_back(
-        new PollTask(std::forward<PollCallback>(kEmptyFunction), fd, 0));
-  }
-  PingPipe();
+  AddPollTask(poll_task_allocator_.New<PollTask>(
+      std::forward<PollCallback>(kEmptyFunction), fd, 0, 0));
 }
 
 void EventLoop::Run() {
-  std::vector<Task*> pending;
-  std::vector<PollTask*> pending_poll;
-  std::unordered_map<int, PollTask*> fd_to_poll_task;
-  uint8 buffer[1024];
-  std::vector<pollfd> poll_array(1);
-  int ret;
+  std::vector<Poller::Event> events;
+  std::vector<TimerWheel::Timer*> expired;
 
 #ifndef NDEBUG
   DCHECK(!running_);
@@ -198,117 +434,84 @@ void EventLoop::Run() {
 #endif
 
   DCHECK(!Current());
-  if (!SetCurrent(this))
-    return;
+  SetCurrent(this);
 
-  poll_array[0].fd = pipe_read_;
-  poll_array[0].events = POLLIN;
-  poll_array[0].revents = 0;
+  // The loop is awake; producers don't have to signal it until it is about to
+  // block again.
+  wakeup_pending_ = true;
+  tasks_since_poll_ = 0;
+  if (budget_time_ != TimeDelta())
+    last_poll_ = Now();
 
   for (;;) {
     bool did_work = false;
-    int milliseconds_to_next_delayed = -1;
+    PreciseTimeDelta next_delayed(-1);
 
-    // This loop executes all work immediately available.
+    // This loop executes all work immediately available, unless it goes over
+    // the fairness budget.
+    bool over_budget = false;
     do {
-      // Flush the pipe.
-      do {
-        ret = read(pipe_read_, buffer, arraysize(buffer));
-      } while (ret > 0);
-      if (ret == 0 || (ret == -1 && errno != EAGAIN)) {
-        DLOG(FATAL) << "reading from pipe_read_ failed, errno: " << errno;
-        return;
-      }
-      // If more work arrives now, |pipe_read_| will become readable and make
-      // poll() return immediately.
-
-      Time now = Now();
-      milliseconds_to_next_delayed = -1;
-      {
-        ScopedLock lock(pending_lock_);
-        pending.swap(pending_);
-        pending_poll.swap(pending_poll_);
-
-        while (!pending_delayed_.empty() &&
-               pending_delayed_.top().when <= now) {
-          pending.push_back(pending_delayed_.top().task);
-          pending_delayed_.pop();
-        }
-
-        if (!pending_delayed_.empty()) {
-          milliseconds_to_next_delayed =
-              ToTimeDelta(pending_delayed_.top().when - now).count();
-        }
+      InsertPendingPoll();
+      did_work = RunReadyTasks();
+      over_budget = OverBudget();
+
+      // The delayed tasks that are due are queued after the immediate tasks,
+      // so that cancellations posted from other threads are processed first.
+      // They keep their DelayedTask until they run, so that their
+      // TimerHandles can still cancel them.
+      uint64 now = ticks_before(Now());
+      InsertPendingDelayed();
+      timers_.Advance(now, &expired);
+      for (TimerWheel::Timer* timer: expired) {
+        DelayedTask* delayed = static_cast<DelayedTask*>(timer);
+        if (take_sample(task_sampling_interval(), &due_samples_))
+          delayed->task->ready_time = MonotonicNanos();
+        AppendReady(delayed->task);
       }
+      did_work = did_work || !expired.empty();
+      expired.clear();
 
-      for (PollTask* t: pending_poll) {
-        if (t->events) {
-          DCHECK(fd_to_poll_task.find(t->fd) == fd_to_poll_task.end());
-          fd_to_poll_task[t->fd] = t;
-          poll_array.push_back(pollfd());
-          poll_array.back().fd = t->fd;
-          poll_array.back().events = t->events;
-          poll_array.back().revents = 0;
-        } else {
-          for (size_t i = 1; i < poll_array.size(); ++i) {
-            if (poll_array[i].fd == t->fd) {
-              poll_array[i] = poll_array.back();
-              poll_array.pop_back();
-              break;
-            }
-          }
-          if (fd_to_poll_task.find(t->fd) != fd_to_poll_task.end()) {
-            delete fd_to_poll_task[t->fd];
-            fd_to_poll_task.erase(t->fd);
-          }
-          delete t;
-        }
+      next_delayed = PreciseTimeDelta(-1);
+      if (timers_.size()) {
+        uint64 next = timers_.NextExpiry();
+        next_delayed = PreciseTimeDelta(
+            next - now > (uint64) kint64max ? kint64max : next - now);
       }
-      pending_poll.clear();
+    } while (did_work && !over_budget);
 
-      did_work = !pending.empty();
-      DLOG(DEBUG) << "doing work, #tasks: " << pending.size();
-      for (Task* t: pending)
-        HandleAndDelete(t);
-      pending.clear();
-    } while (did_work);
+    if (over_budget) {
+      // Look at the descriptors without blocking, and then go on with the
+      // work that is still ready.
+      if (!PollAndDispatch(PreciseTimeDelta(), &events))
+        return;
+      continue;
+    }
 
     if (quit_soon_)
       break;
 
-    // Didn't do any work in the last iteration; poll for more.
-    DLOG(DEBUG) << "polling for " << milliseconds_to_next_delayed << "ms with "
-                << poll_array.size() << " fds...";
-    if (poll(&poll_array.front(),
-             poll_array.size(),
-             milliseconds_to_next_delayed) == -1 && errno != EAGAIN) {
-      DLOGE(FATAL) << "poll failed";
-      return;
-    }
-    DLOG(DEBUG) << "poll woke up";
-
-    for (size_t i = 1; i < poll_array.size(); ) {
-      pollfd& pfd = poll_array[i];
-      if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL | pfd.events)) {
-        DLOG(VERBOSE) << "fd ready: " << pfd.fd << ", revents: " << pfd.revents;
-        DCHECK(fd_to_poll_task.find(pfd.fd) != fd_to_poll_task.end());
-        HandleAndDeletePolled(fd_to_poll_task[pfd.fd], pfd.revents);
-        fd_to_poll_task.erase(pfd.fd);
-        poll_array[i] = poll_array.back();
-        poll_array.pop_back();
-      } else {
-        ++i;
-      }
+    // With busy polling, look for work for a while before blocking. Producers
+    // don't signal the loop meanwhile, since |wakeup_pending_| is still set.
+    uint64 idle_start = 0;
+    if (max_spin_ != PreciseTimeDelta()) {
+      idle_start = MonotonicNanos();
+      if (Spin(idle_start, next_delayed, &events))
+        continue;
     }
-  }
 
-  if (!fd_to_poll_task.empty()) {
-    DLOG(WARNING) << "EventLoop still has PollTasks, moving to pending_poll_";
-    {
-      ScopedLock lock(pending_lock_);
-      for (auto i: fd_to_poll_task)
-        pending_poll_.push_back(i.second);
+    // From now on producers have to signal |wakeup_write_|. Anything posted
+    // since the last look didn't, so check once more before blocking.
+    wakeup_pending_ = false;
+    if (HasPendingWork()) {
+      wakeup_pending_ = true;
+      continue;
     }
+
+    // Didn't do any work in the last iteration; poll for more.
+    if (!PollAndDispatch(next_delayed, &events))
+      return;
+    if (idle_start)
+      UpdateSpinWindow(MonotonicNanos() - idle_start, false);
   }
 
   SetCurrent(NULL);
@@ -319,39 +522,705 @@ void EventLoop::Run() {
 #endif
 }
 
+bool EventLoop::HasPendingWork() {
+  bool has_work = quit_soon_ || !pending_delayed_.empty();
+  for (int i = 0; i < kPriorities; ++i)
+    has_work = has_work || lanes_[i].first || !pending_[i].empty();
+  return has_work || has_pending_poll_.load(std::memory_order_acquire);
+}
+
+bool EventLoop::Spin(uint64 start, const PreciseTimeDelta& next_delayed,
+                     std::vector<Poller::Event>* events) {
+  // A delayed task that is due ends the spin too.
+  uint64 limit = spin_window_.load(std::memory_order_relaxed);
+  bool timer_due = false;
+  if (next_delayed.count() >= 0 &&
+      (uint64) next_delayed.count() * 1000 <= limit) {
+    limit = next_delayed.count() * 1000;
+    timer_due = true;
+  }
+
+  bool found = false;
+  uint64 now = start;
+  uint64 cpu_start = ThreadCpuNanos();
+  for (;;) {
+    found = HasPendingWork();
+    if (!found) {
+      events->clear();
+      if (!poller_->Wait(PreciseTimeDelta(), events)) {
+        DLOG(FATAL) << "poll failed";
+        return false;
+      }
+      found = !events->empty();
+      if (found)
+        DispatchEvents(*events);
+    }
+    now = MonotonicNanos();
+    if (found || now - start >= limit)
+      break;
+    cpu_relax();
+  }
+
+  spin_time_.Record(ThreadCpuNanos() - cpu_start);
+  if (found) {
+    spin_hits_.store(spin_hits_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    UpdateSpinWindow(now - start, true);
+  }
+  return found || timer_due;
+}
+
+void EventLoop::UpdateSpinWindow(uint64 idle_nanos, bool hit) {
+  // Spinning pays off when work usually shows up within the window, so it
+  // follows the recent idle periods: an average that weighs the last one by
+  // 1/8. Spinning stops while they are longer than |max_spin_|, but the
+  // average is still updated after blocking, so it starts again once work
+  // comes in faster.
+  idle_average_ += ((int64) idle_nanos - idle_average_) / 8;
+  int64 max = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      max_spin_).count();
+  int64 window = idle_average_ <= max ? std::min(max, 2 * idle_average_) : 0;
+  // A miss halves the window at least. Idle periods can look short because
+  // the producer couldn't run while the loop was spinning, e.g. on the same
+  // CPU; only hits let it grow again, so every so often a miss probes with the
+  // full window.
+  if (!hit && ++spin_misses_ % kSpinProbeInterval != 0) {
+    window = std::min<int64>(
+        window, spin_window_.load(std::memory_order_relaxed) / 2);
+  }
+  spin_window_.store(window, std::memory_order_relaxed);
+}
+
+bool EventLoop::PollAndDispatch(const PreciseTimeDelta& timeout,
+                                std::vector<Poller::Event>* events) {
+  DLOG(DEBUG) << "polling for " << timeout.count() << "us with "
+              << poller_->size() << " fds...";
+  events->clear();
+  uint64 start = MonotonicNanos();
+  if (!poller_->Wait(timeout, events)) {
+    DLOG(FATAL) << "poll failed";
+    return false;
+  }
+  poll_time_.Record(MonotonicNanos() - start);
+  DLOG(DEBUG) << "poll woke up";
+  DispatchEvents(*events);
+  return true;
+}
+
+void EventLoop::DispatchEvents(const std::vector<Poller::Event>& events) {
+  wakeup_pending_ = true;
+  tasks_since_poll_ = 0;
+  if (budget_time_ != TimeDelta())
+    last_poll_ = Now();
+
+  // Only the ready descriptors are visited here. One-shot PollTasks are
+  // removed before running them, so that they can close their descriptor.
+  dispatching_ = true;
+  size_t ready_fds = events.size();
+  for (const Poller::Event& event: events) {
+    if (!event.data) {
+      FlushWakeup();
+      ready_fds--;
+      continue;
+    }
+    if (!event.revents) {
+      CompleteIo(static_cast<IoTask*>(event.data), event.result);
+      continue;
+    }
+    int fd = data_to_fd(event.data);
+    DLOG(VERBOSE) << "fd ready: " << fd << ", revents: " << event.revents;
+    const int kErrors = POLLERR | POLLHUP | POLLNVAL;
+    if (event.revents & (POLLIN | kErrors))
+      DispatchPolled(fd, &FdState::read, event.revents);
+    if (event.revents & (POLLOUT | kErrors))
+      DispatchPolled(fd, &FdState::write, event.revents);
+  }
+  dispatching_ = false;
+  for (PollTask* task: released_poll_)
+    poll_task_allocator_.Delete(task);
+  released_poll_.clear();
+  ready_fds_.Record(ready_fds);
+}
+
+void EventLoop::SetFairnessBudget(size_t tasks, const TimeDelta& time) {
+  budget_tasks_ = tasks;
+  budget_time_ = time;
+  last_poll_ = Now();
+}
+
+void EventLoop::SetBusyPoll(const PreciseTimeDelta& max_spin) {
+  DCHECK(max_spin.count() >= 0);
+  max_spin_ = max_spin;
+  // Start with the full window, until the loop learns better.
+  idle_average_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      max_spin).count() / 2;
+  spin_window_ = idle_average_ * 2;
+}
+
+void EventLoop::SetTaskSampling(uint32 interval) {
+  task_sampling_interval_.store(interval, std::memory_order_relaxed);
+}
+
+void EventLoop::SetStarvationRatio(int ratio) {
+  DCHECK(ratio > 0);
+  starvation_ratio_ = ratio;
+}
+
+EventLoop::AllocationStats EventLoop::allocation_stats() const {
+  AllocationStats stats;
+  stats.tasks = task_allocator_.stats();
+  stats.poll_tasks = poll_task_allocator_.stats();
+  stats.delayed_tasks = delayed_task_allocator_.stats();
+  stats.io_tasks = io_task_allocator_.stats();
+  return stats;
+}
+
+double EventLoop::RuntimeStats::WakeupsPerSecond(
+    const RuntimeStats& earlier) const {
+  if (time <= earlier.time)
+    return 0;
+  return (poll_time.count - earlier.poll_time.count) * 1e9 /
+         (time - earlier.time);
+}
+
+EventLoop::RuntimeStats EventLoop::runtime_stats() const {
+  RuntimeStats stats;
+  stats.time = MonotonicNanos();
+  stats.queue_depth = queue_depth_.GetSnapshot();
+  stats.task_latency = task_latency_.GetSnapshot();
+  stats.task_run_time = task_run_time_.GetSnapshot();
+  stats.poll_time = poll_time_.GetSnapshot();
+  stats.ready_fds = ready_fds_.GetSnapshot();
+  stats.spin_time = spin_time_.GetSnapshot();
+  stats.spin_hits = spin_hits_.load(std::memory_order_relaxed);
+  stats.spin_window = spin_window_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 void EventLoop::QuitSoon() {
   quit_soon_ = true;
-  PingPipe();
+  Wakeup();
 }
 
 // static
-bool EventLoop::SetCurrent(EventLoop* loop) {
-  if (!current_key_is_valid())
-    return false;
+void EventLoop::SetCurrent(EventLoop* loop) {
+  current_ = loop;
+}
+
+void EventLoop::InsertPendingDelayed() {
+  DelayedTask* delayed = pending_delayed_.TakeAll();
+  while (delayed) {
+    DelayedTask* next = delayed->next;
+    timers_.Add(delayed, delayed->expiry);
+    delayed = next;
+  }
+}
+
+void EventLoop::CancelDelayed(DelayedTask* delayed, uint64 id) {
+  // |delayed| might still be in |pending_delayed_|.
+  InsertPendingDelayed();
+  if (delayed->id.load(std::memory_order_relaxed) != id)
+    return;
+  if (delayed->is_scheduled()) {
+    timers_.Remove(delayed);
+    task_allocator_.Delete(delayed->task);
+    DeleteDelayed(delayed);
+    return;
+  }
+  // It's due, and waiting in a Lane. It's released now, and skipped when its
+  // turn comes.
+  delayed->id.store(0, std::memory_order_relaxed);
+  delayed->task->callback.Reset();
+}
+
+void EventLoop::DeleteDelayed(DelayedTask* delayed) {
+  // Stale TimerHandles look at |id| after this.
+  delayed->id.store(0, std::memory_order_relaxed);
+  delayed_task_allocator_.Delete(delayed);
+}
+
+void EventLoop::AddPollTask(PollTask* task) {
+  if (IsCurrent()) {
+    // Keep the order with the tasks added by other threads.
+    InsertPendingPoll();
+    RegisterPollTask(task);
+    return;
+  }
+  {
+    ScopedLock lock(pending_lock_);
+    pending_poll_.push_back(task);
+    has_pending_poll_.store(true, std::memory_order_release);
+  }
+  Wakeup();
+}
+
+void EventLoop::InsertPendingPoll() {
+  // Most iterations have nothing to insert; skip the lock for those.
+  if (!has_pending_poll_.load(std::memory_order_acquire))
+    return;
+  {
+    ScopedLock lock(pending_lock_);
+    inserting_poll_.swap(pending_poll_);
+    has_pending_poll_.store(false, std::memory_order_relaxed);
+  }
+  for (PollTask* task: inserting_poll_)
+    RegisterPollTask(task);
+  inserting_poll_.clear();
+}
+
+void EventLoop::RegisterPollTask(PollTask* task) {
+  if (task->events) {
+    FdState& state = GetFdState(task->fd);
+    int old_events = state.events();
+    PollTask*& slot = task->events == POLLIN ? state.read : state.write;
+    DCHECK(!slot);
+    slot = task;
+    if (task->watch_id)
+      watchers_[task->watch_id] = task;
+    UpdatePoller(task->fd, old_events);
+    return;
+  }
+  if (task->watch_id) {
+    // Stops a watcher. It might be gone already, e.g. if its descriptor was
+    // cancelled; then this does nothing.
+    RemoveWatcher(task->watch_id);
+    poll_task_allocator_.Delete(task);
+    return;
+  }
+  FdState* state = FindFdState(task->fd);
+  if (state && state->events()) {
+    poller_->Remove(task->fd);
+    for (PollTask* cancelled: { state->read, state->write }) {
+      if (!cancelled)
+        continue;
+      if (cancelled->watch_id)
+        watchers_.erase(cancelled->watch_id);
+      ReleasePollTask(cancelled);
+    }
+    state->read = NULL;
+    state->write = NULL;
+  }
+  CancelIo(task->fd);
+  poll_task_allocator_.Delete(task);
+}
+
+EventLoop::FdState* EventLoop::FindFdState(int fd) {
+  if (fd < 0 || static_cast<size_t>(fd) >= fd_states_.size())
+    return NULL;
+  return &fd_states_[fd];
+}
+
+EventLoop::FdState& EventLoop::GetFdState(int fd) {
+  DCHECK(fd >= 0);
+  if (static_cast<size_t>(fd) >= fd_states_.size())
+    fd_states_.resize(fd + 1);
+  return fd_states_[fd];
+}
+
+void EventLoop::UpdatePoller(int fd, int old_events) {
+  FdState* state = FindFdState(fd);
+  int events = state ? state->events() : 0;
+  if (events == old_events)
+    return;
+  if (!events) {
+    poller_->Remove(fd);
+  } else if (!old_events) {
+    poller_->Add(fd, events, fd_to_data(fd));
+  } else {
+    poller_->Modify(fd, events, fd_to_data(fd));
+  }
+}
+
+void EventLoop::DispatchPolled(int fd, PollTask* FdState::*slot,
+                               int revents) {
+  // A previous callback might have changed the state of |fd|.
+  FdState* state = FindFdState(fd);
+  if (!state)
+    return;
+  PollTask* task = state->*slot;
+  if (!task)
+    return;
+  if (task->watch_id) {
+    RunWatcher(task, revents);
+    return;
+  }
+  int old_events = state->events();
+  state->*slot = NULL;
+  UpdatePoller(fd, old_events);
+  HandleAndDeletePolled(task, revents);
+}
+
+void EventLoop::ReleasePollTask(PollTask* task) {
+  if (dispatching_) {
+    task->events = 0;
+    released_poll_.push_back(task);
+  } else {
+    poll_task_allocator_.Delete(task);
+  }
+}
+
+void EventLoop::StopWatch(uint64 id) {
+  // |id| might still be in |pending_poll_|.
+  InsertPendingPoll();
+  RemoveWatcher(id);
+}
+
+void EventLoop::RemoveWatcher(uint64 id) {
+  auto it = watchers_.find(id);
+  if (it == watchers_.end())
+    return;
+  PollTask* task = it->second;
+  watchers_.erase(it);
+  FdState& state = GetFdState(task->fd);
+  int old_events = state.events();
+  (task->events == POLLIN ? state.read : state.write) = NULL;
+  UpdatePoller(task->fd, old_events);
+  ReleasePollTask(task);
+}
+
+void EventLoop::RunWatcher(PollTask* task, int revents) {
+  // |task| might be released by its own callback, but only after dispatching.
+  task->callback(revents & POLLNVAL, revents & POLLHUP, revents & POLLERR);
+  if ((revents & POLLNVAL) && task->events)
+    StopWatch(task->watch_id);
+}
+
+void EventLoop::StartIo(IoTask* task) {
+  DCHECK(IsCurrent());
+  task->next = io_tasks_;
+  if (io_tasks_)
+    io_tasks_->prev = task;
+  io_tasks_ = task;
+  // Falls back to waiting for readiness if the poller is backed up.
+  if (!poller_->SupportsCompletions() ||
+      !poller_->Submit(task->op, task->fd, task->buffer, task->size, task)) {
+    WaitForIo(task);
+  }
+}
+
+void EventLoop::WaitForIo(IoTask* task) {
+  task->polling = true;
+  PollCallback f = Bind(&EventLoop::PerformIo, this, task);
+  if (task->op == Poller::WRITE)
+    PostWhenWriteReady(task->fd, std::move(f));
+  else
+    PostWhenReadReady(task->fd, std::move(f));
+}
+
+void EventLoop::PerformIo(IoTask* task, bool nval, bool hup, bool err) {
+  task->polling = false;
+  if (nval) {
+    CompleteIo(task, -EBADF);
+    return;
+  }
+  int result = perform_operation(task->op, task->fd, task->buffer,
+                                 task->size);
+  if (result == -EAGAIN)
+    WaitForIo(task);
+  else
+    CompleteIo(task, result);
+}
+
+void EventLoop::CancelIo(int fd) {
+  for (IoTask* task = io_tasks_; task; task = task->next) {
+    if (task->fd != fd || task->cancelled)
+      continue;
+    task->cancelled = true;
+    // The PollTasks of tasks that are polling have just been cancelled.
+    if (task->polling)
+      Post(Bind(&EventLoop::CompleteIo, this, task, -ECANCELED));
+    else
+      poller_->Cancel(task);
+  }
+}
+
+void EventLoop::CompleteIo(IoTask* task, int result) {
+  // io_uring doesn't wait for non-blocking descriptors to be ready.
+  if (result == -EAGAIN) {
+    if (!task->cancelled) {
+      WaitForIo(task);
+      return;
+    }
+    result = -ECANCELED;
+  }
+  if (task->prev)
+    task->prev->next = task->next;
+  else
+    io_tasks_ = task->next;
+  if (task->next)
+    task->next->prev = task->prev;
+  task->callback(result);
+  io_task_allocator_.Delete(task);
+}
+
+void EventLoop::PushTasks(Task* first, Task* last, size_t count,
+                          Priority priority) {
+  // The latency of a batch is sampled through its first task.
+  if (take_sample(task_sampling_interval(), &g_post_samples))
+    first->ready_time = MonotonicNanos();
+  pending_tasks_.fetch_add(count, std::memory_order_relaxed);
+  // The loop's own thread appends to the ready lane, which only it uses; the
+  // loop looks at it before blocking, so there's nothing to wake up either.
+  // The tasks other threads posted so far go first, to keep their order.
+  if (current_ == this) {
+    if (!pending_[priority].empty())
+      TakePending(priority);
+    Lane& lane = lanes_[priority];
+    if (lane.last)
+      lane.last->next = first;
+    else
+      lane.first = first;
+    lane.last = last;
+    lane.size += count;
+    return;
+  }
+  pending_[priority].PushList(first, last);
+  Wakeup();
+}
+
+void EventLoop::Wakeup() {
+  // Only the first producer after the loop started to block has to signal it.
+  if (wakeup_pending_.exchange(true))
+    return;
+#if defined(__linux__)
+  uint64 value = 1;
+#else
+  uint8 value = 0;
+#endif
+  if (write(wakeup_write_, &value, sizeof(value)) != sizeof(value))
+    DLOGE(FATAL) << "writing to wakeup_write_ failed";
+}
+
+void EventLoop::FlushWakeup() {
+#if defined(__linux__)
+  uint64 buffer;
+#else
+  uint8 buffer[64];
+#endif
   int ret;
-  if ((ret = pthread_setspecific(current_key, loop)) != 0) {
-    DLOG(FATAL) << "pthread_set_specific failed: " << ret;
+  do {
+    ret = read(wakeup_read_, &buffer, sizeof(buffer));
+  } while (ret > 0);
+  if (ret == 0 || (ret == -1 && errno != EAGAIN))
+    DLOG(FATAL) << "reading from wakeup_read_ failed, errno: " << errno;
+}
+
+void EventLoop::WatchHandle::Stop() {
+  if (!loop_)
+    return;
+  if (loop_->IsCurrent()) {
+    loop_->StopWatch(id_);
+  } else {
+    // This goes through |pending_poll_| to keep its order with the watchers
+    // started afterwards.
+    loop_->AddPollTask(loop_->poll_task_allocator_.New<PollTask>(
+        PollCallback(), -1, 0, id_));
+  }
+  loop_ = NULL;
+}
+
+EventLoop::Batch::Batch(EventLoop* loop, size_t max_size,
+                        const TimeDelta& max_delay, Priority priority)
+    : loop_(loop),
+      max_size_(max_size),
+      max_delay_(max_delay),
+      priority_(priority),
+      first_(NULL),
+      last_(NULL),
+      size_(0),
+      timer_armed_(false),
+      weak_factory_(this) {
+  DCHECK(max_size_ > 0);
+}
+
+EventLoop::Batch::~Batch() {
+  Flush();
+}
+
+void EventLoop::Batch::Post(Callback&& f) {
+  DCHECK(checker_.Check());
+  Task* task = loop_->task_allocator_.New<Task>(std::forward<Callback>(f),
+                                                priority_);
+  if (last_) {
+    last_->next = task;
+  } else {
+    first_ = task;
+    if (max_delay_ != TimeDelta()) {
+      first_time_ = Now();
+      ArmFlushTimer(max_delay_);
+    }
+  }
+  last_ = task;
+  size_++;
+  if (size_ >= max_size_ ||
+      (max_delay_ != TimeDelta() && Now() - first_time_ >= max_delay_)) {
+    Flush();
+  }
+}
+
+void EventLoop::Batch::Flush() {
+  DCHECK(checker_.Check());
+  if (!first_)
+    return;
+  loop_->PushTasks(first_, last_, size_, priority_);
+  first_ = last_ = NULL;
+  size_ = 0;
+}
+
+void EventLoop::Batch::ArmFlushTimer(const PreciseTimeDelta& delay) {
+  // An armed timer is left alone when the batch is flushed, and checks the
+  // age of the batch that is there when it fires.
+  EventLoop* current = Current();
+  if (!current || timer_armed_)
+    return;
+  timer_armed_ = true;
+  current->PostAfter(Bind(&Batch::OnFlushTimer, weak_factory_.GetWeakPtr()),
+                     delay);
+}
+
+void EventLoop::Batch::OnFlushTimer() {
+  DCHECK(checker_.Check());
+  timer_armed_ = false;
+  if (!first_)
+    return;
+  PreciseTimeDelta age = ToPreciseTimeDelta(Now() - first_time_);
+  if (age >= max_delay_)
+    Flush();
+  else
+    ArmFlushTimer(max_delay_ - age);
+}
+
+void EventLoop::TimerHandle::Cancel() {
+  if (!loop_)
+    return;
+  if (loop_->IsCurrent())
+    loop_->CancelDelayed(delayed_, id_);
+  else
+    loop_->Post(Bind(&EventLoop::CancelDelayed, loop_, delayed_, id_), HIGH);
+  loop_ = NULL;
+}
+
+void EventLoop::TakePending(int priority) {
+  Task* task = pending_[priority].TakeAll();
+  if (!task)
+    return;
+  Lane& lane = lanes_[priority];
+  if (lane.last)
+    lane.last->next = task;
+  else
+    lane.first = task;
+  lane.size++;
+  while (task->next) {
+    task = task->next;
+    lane.size++;
+  }
+  lane.last = task;
+}
+
+void EventLoop::AppendReady(Task* task) {
+  pending_tasks_.fetch_add(1, std::memory_order_relaxed);
+  Lane& lane = lanes_[task->priority];
+  task->next = NULL;
+  if (lane.last)
+    lane.last->next = task;
+  else
+    lane.first = task;
+  lane.last = task;
+  lane.size++;
+}
+
+EventLoop::Task* EventLoop::NextReadyTask() {
+  // The highest priority that is ready, unless a lower one has waited enough.
+  int priority = -1;
+  for (int i = 0; i < kPriorities; ++i) {
+    if (!lanes_[i].first)
+      continue;
+    if (priority == -1 || lanes_[i].skipped >= starvation_ratio_)
+      priority = i;
+  }
+  if (priority == -1)
+    return NULL;
+  for (int i = priority + 1; i < kPriorities; ++i) {
+    if (lanes_[i].first)
+      lanes_[i].skipped++;
+  }
+  Lane& lane = lanes_[priority];
+  lane.skipped = 0;
+  Task* task = lane.first;
+  lane.first = task->next;
+  if (!lane.first)
+    lane.last = NULL;
+  lane.size--;
+  return task;
+}
+
+bool EventLoop::RunReadyTasks() {
+  // Runs as many tasks as are ready now, so that tasks that keep posting more
+  // don't keep the loop from its timers and descriptors. The tasks posted
+  // meanwhile are taken too, so that higher priorities can go first.
+  size_t budget = 0;
+  for (int i = 0; i < kPriorities; ++i) {
+    TakePending(i);
+    budget += lanes_[i].size;
+  }
+  if (!budget)
     return false;
+  queue_depth_.Record(budget);
+
+  // Only the sampled tasks read the clock.
+  uint32 interval = task_sampling_interval();
+  size_t ran = 0;
+  for (; ran < budget; ++ran) {
+    for (int i = 0; i < kPriorities; ++i) {
+      if (!pending_[i].empty())
+        TakePending(i);
+    }
+    Task* task = NextReadyTask();
+    if (!task)
+      break;
+    bool timed = take_sample(interval, &run_samples_);
+    uint64 start = 0;
+    if (timed || task->ready_time)
+      start = MonotonicNanos();
+    if (task->ready_time) {
+      task_latency_.Record(start > task->ready_time ? start - task->ready_time
+                                                     : 0);
+    }
+    HandleAndDelete(task);
+    if (timed)
+      task_run_time_.Record(MonotonicNanos() - start);
+    tasks_since_poll_++;
+    if (OverBudget()) {
+      ran++;
+      break;
+    }
   }
-  return true;
+  return ran > 0;
 }
 
-void EventLoop::PingPipe() {
-  static uint8 byte = 0;
-  // This can block if the pipe buffer is full, which also means the loop is
-  // taking too long on some iteration.
-  if (write(pipe_write_, &byte, 1) != 1)
-    DLOGE(FATAL) << "writing to pipe_write_ failed";
+bool EventLoop::OverBudget() const {
+  if (budget_tasks_ && tasks_since_poll_ >= budget_tasks_)
+    return true;
+  return budget_time_ != TimeDelta() && Now() - last_poll_ >= budget_time_;
 }
 
 void EventLoop::HandleAndDelete(Task* task) {
-  task->callback();
+  if (task->delayed) {
+    // It can't be cancelled anymore, even by its own callback.
+    task->delayed->id.store(0, std::memory_order_relaxed);
+  }
+  // Cancelled delayed tasks are left empty.
+  if (task->callback)
+    task->callback();
   if (task->reply)
-    task->reply_loop->Post(std::move(task->reply));
-  delete task;
+    task->reply_loop->Post(std::move(task->reply), task->priority);
+  if (task->delayed)
+    DeleteDelayed(task->delayed);
+  task_allocator_.Delete(task);
+  pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
 }
 
 void EventLoop::HandleAndDeletePolled(PollTask* task, int revents) {
   task->callback(revents & POLLNVAL, revents & POLLHUP, revents & POLLERR);
-  delete task;
+  poll_task_allocator_.Delete(task);
 }
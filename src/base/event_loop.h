@@ -1,35 +1,151 @@
 #ifndef BASE_EVENT_LOOP_H
 #define BASE_EVENT_LOOP_H
 
+#include <atomic>
 #include <functional>
-#include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "base/base.h"
 #include "base/bind.h"
+#include "base/histogram.h"
 #include "base/memory.h"
+#include "base/mpsc_queue.h"
+#include "base/once_callback.h"
+#include "base/poller.h"
+#include "base/slab_allocator.h"
+#include "base/thread_checker.h"
 #include "base/time.h"
+#include "base/timer_wheel.h"
+#include "base/weak.h"
 
 class BaseTest;
 
 class EventLoop {
+ private:
+  struct DelayedTask;
+
  public:
-  typedef std::function<void()> Callback;
+  // Tasks are moved in and run once, so they can own move-only state; see
+  // BindOnce(). Small ones are stored in the Task without allocating.
+  typedef OnceCallback<void()> Callback;
   typedef std::function<void(bool nval, bool hup, bool err)> PollCallback;
+  // Receives the result of an operation: what its syscall returns, or -errno
+  // on failure.
+  typedef std::function<void(int result)> IoCallback;
+
+  // Ready tasks run in priority order, but tasks of lower priorities still
+  // get a share of the loop; see SetStarvationRatio().
+  enum Priority {
+    // Latency critical work, like replies.
+    HIGH,
+    NORMAL,
+    // Bulk work that can wait, like flushing logs or refilling caches.
+    BACKGROUND,
+  };
 
   ~EventLoop();
 
-  static unique_ptr<EventLoop> Create();
+  // Returns a new EventLoop that waits for file descriptors using |backend|,
+  // or NULL if that backend isn't available.
+  static unique_ptr<EventLoop> Create(
+      Poller::Backend backend = Poller::DEFAULT);
 
-  static EventLoop* Current();
-  bool IsCurrent() const { return Current() == this; }
+  // Identifies a task posted with PostAfter(), and can cancel it. It's cheap
+  // to copy, and must not be used after its EventLoop is deleted.
+  class TimerHandle {
+   public:
+    TimerHandle() : loop_(NULL), delayed_(NULL), id_(0) {}
 
-  void Post(Callback&& f);
-  void PostAndReply(Callback&& f, Callback&& reply);
-  void PostAfter(Callback&& f, const TimeDelta& delay);
+    // Cancels the task, if it hasn't started running yet. On the loop's
+    // thread the task is released before returning, even if it was already
+    // due and waiting for its turn. On other threads the cancellation is
+    // posted to the loop, and the task might still run.
+    void Cancel();
+
+   private:
+    friend class EventLoop;
+
+    TimerHandle(EventLoop* loop, DelayedTask* delayed, uint64 id)
+        : loop_(loop), delayed_(delayed), id_(id) {}
+
+    EventLoop* loop_;
+    // Might have been released and reused already; |id_| tells.
+    DelayedTask* delayed_;
+    uint64 id_;
+  };
+
+  // Identifies a watcher started with WatchReadable() or WatchWritable(), and
+  // can stop it. It's cheap to copy, and must not be used after its EventLoop
+  // is deleted.
+  class WatchHandle {
+   public:
+    WatchHandle() : loop_(NULL), id_(0) {}
+
+    // Stops the watcher. On the loop's thread its callback won't be invoked
+    // again once this returns, and is released right away or as soon as it
+    // returns if it's running. On other threads the stop is posted to the
+    // loop, and the callback might still be invoked meanwhile; the descriptor
+    // can be watched again right away, though.
+    void Stop();
+
+   private:
+    friend class EventLoop;
+
+    WatchHandle(EventLoop* loop, uint64 id) : loop_(loop), id_(id) {}
+
+    EventLoop* loop_;
+    uint64 id_;
+  };
+
+  class Batch;
+
+  // Returns the loop running on the calling thread, if any.
+  static EventLoop* Current() { return current_; }
+  bool IsCurrent() const { return current_ == this; }
+
+  // The reply of PostAndReply() is posted with the same |priority|, and
+  // PostAfter() uses |priority| once the task is due. Delays have microsecond
+  // resolution; see Poller::Wait() for where the wait for them does too.
+  // Tasks posted from the loop's own thread skip the synchronization and the
+  // wakeup that other threads need.
+  void Post(Callback&& f, Priority priority = NORMAL);
+  void PostAndReply(Callback&& f, Callback&& reply,
+                    Priority priority = NORMAL);
+  TimerHandle PostAfter(Callback&& f, const PreciseTimeDelta& delay,
+                        Priority priority = NORMAL);
+  // Posts all of |tasks|, in order, with a single synchronization and at most
+  // one wakeup. See also Batch.
+  void PostBatch(std::vector<Callback>&& tasks, Priority priority = NORMAL);
   void PostWhenReadReady(int fd, PollCallback&& f);
   void PostWhenWriteReady(int fd, PollCallback&& f);
 
+  // Invokes |f| every time |fd| is readable or writable, until the watcher is
+  // stopped. This is level triggered: |f| should consume the data or stop the
+  // watcher, or it is invoked again on the next iteration. A watcher whose
+  // |fd| becomes invalid is stopped after |f| is invoked with |nval|.
+  //
+  // Unlike the PostWhen* methods, these are meant to be started once per
+  // descriptor; on the loop's thread they don't take any lock.
+  WatchHandle WatchReadable(int fd, PollCallback&& f);
+  WatchHandle WatchWritable(int fd, PollCallback&& f);
+
+  // Reads up to |size| bytes from |fd| into |buffer|, and then invokes |f|
+  // with the result. With Poller::IO_URING the read is submitted to the
+  // kernel, which completes it without further syscalls; other backends wait
+  // until |fd| is readable and then read(2) it. |buffer| must stay valid
+  // until |f| is invoked. Like the PostWhen* methods, there can only be one
+  // read or accept waiting for |fd| at a time, and one write.
+  //
+  // These can only be invoked on the loop's thread. They work with the fd()
+  // of a FileDescriptor or Socket, which should be non-blocking.
+  void PostRead(int fd, void* buffer, size_t size, IoCallback&& f);
+  void PostWrite(int fd, const void* buffer, size_t size, IoCallback&& f);
+  // Accepts a connection on the listening socket |fd|, and then invokes |f|
+  // with the new descriptor, which is non-blocking and close-on-exec. See
+  // Socket::AdoptConnection().
+  void PostAccept(int fd, IoCallback&& f);
+
   // TODO: Bind() can't bind functors, but std::bind() can. This is because
   // CallableTraits<> can't take a struct with operator().
   template<typename T>
@@ -37,14 +153,97 @@ class EventLoop {
     Post(std::bind(std::default_delete<T>(), ptr));
   }
 
-  // Cancels a task that is waiting for |fd|, if any. Such a task can still be
-  // invoked after |CancelDescriptor| returns; if the |fd| can be closed in
-  // another thread, the task should be protected with a WeakFlag.
+  // Cancels a task or watcher that is waiting for |fd|, if any. Such a task
+  // can still be invoked after |CancelDescriptor| returns; if the |fd| can be
+  // closed in another thread, the task should be protected with a WeakFlag.
+  // Operations on |fd| are always completed, with -ECANCELED if they were
+  // cancelled, since the kernel might be using their buffers until then.
   void CancelDescriptor(int fd);
 
   // Keeps running the loop until QuitSoon is invoked.
   void Run();
 
+  // A ready task of a lower priority runs as soon as |ratio| tasks of higher
+  // priorities have run since it could have, even if more of those are ready.
+  // The default is kDefaultStarvationRatio. This must be called before Run(),
+  // or on the loop's thread.
+  void SetStarvationRatio(int ratio);
+  static const int kDefaultStarvationRatio = 8;
+
+  // Bounds the work done between looks at the descriptors, so that tasks that
+  // keep posting more can't starve them. Once |tasks| tasks have run, or
+  // |time| has passed, since the loop last polled, it polls without blocking
+  // before running more. Zero disables either limit. The default is
+  // kDefaultFairnessBudget tasks, without a time limit. This must be called
+  // before Run(), or on the loop's thread.
+  void SetFairnessBudget(size_t tasks, const TimeDelta& time = TimeDelta());
+  static const size_t kDefaultFairnessBudget = 1024;
+
+  // Makes the loop spin for up to |max_spin| before blocking, looking for
+  // tasks and polling the descriptors without blocking. Work that shows up
+  // meanwhile is picked up without a wakeup, and producers skip the syscall
+  // that would signal it. The window adapts to how long the loop has been
+  // idle lately, and drops to zero while that's longer than |max_spin|; see
+  // RuntimeStats for what spinning costs. Zero disables it, the default.
+  // This must be called before Run(), or on the loop's thread.
+  void SetBusyPoll(const PreciseTimeDelta& max_spin);
+
+  // Times one in |interval| tasks for the task_latency and task_run_time
+  // RuntimeStats, so that the others don't pay for reading the clock. One
+  // times every task, and zero none. The default is
+  // kDefaultTaskSamplingInterval. This must be called before Run(), and
+  // before other threads post to the loop.
+  void SetTaskSampling(uint32 interval);
+  static const uint32 kDefaultTaskSamplingInterval = 64;
+
+  // Returns the number of tasks posted to the loop that haven't finished
+  // running yet, including the delayed tasks that are due. Delayed tasks that
+  // aren't due yet and descriptors being watched don't count. This can be
+  // read from any thread.
+  size_t pending_tasks() const {
+    return pending_tasks_.load(std::memory_order_relaxed);
+  }
+
+  // Counters for the nodes that hold posted tasks. These come from slabs that
+  // are reused, so once the loop reaches a steady state |slabs| stops growing
+  // and posting doesn't call malloc, besides what the callbacks allocate.
+  struct AllocationStats {
+    SlabAllocator::Stats tasks;
+    SlabAllocator::Stats poll_tasks;
+    SlabAllocator::Stats delayed_tasks;
+    SlabAllocator::Stats io_tasks;
+  };
+  AllocationStats allocation_stats() const;
+
+  // What the loop has been doing since it was created. Times are in
+  // nanoseconds. This can be read from any thread.
+  struct RuntimeStats {
+    // Returns how many times per second the loop returned from polling since
+    // |earlier| was taken.
+    double WakeupsPerSecond(const RuntimeStats& earlier) const;
+
+    // When the snapshot was taken, from MonotonicNanos().
+    uint64 time;
+    // The ready tasks when the loop starts running a batch of them.
+    Histogram::Snapshot queue_depth;
+    // From posting a task, or from a delayed task being due, until it runs.
+    // These two only cover a sample of the tasks; see SetTaskSampling().
+    Histogram::Snapshot task_latency;
+    Histogram::Snapshot task_run_time;
+    // The time spent in each Poller::Wait(), including non-blocking ones.
+    Histogram::Snapshot poll_time;
+    // The descriptors and completions reported by each Poller::Wait().
+    Histogram::Snapshot ready_fds;
+    // With SetBusyPoll(), the CPU time used by each spin. It's less than how
+    // long the spin lasted if the thread was preempted meanwhile.
+    Histogram::Snapshot spin_time;
+    // The spins that found work, so that the loop didn't block.
+    uint64 spin_hits;
+    // The current spin window.
+    uint64 spin_window;
+  };
+  RuntimeStats runtime_stats() const;
+
   // The loop will quit once all immediately ready tasks have been processed.
   // It will keep any delayed tasks and PollTasks in their queues, which can be
   // resumed by calling Run() again.
@@ -53,27 +252,156 @@ class EventLoop {
  private:
   friend class BaseTest;
 
-  struct DelayedTask;
+  struct IoTask;
   struct PollTask;
+
+  // The tasks waiting for a descriptor to be readable and writable.
+  struct FdState {
+    FdState() : read(NULL), write(NULL) {}
+
+    // The events to register with the Poller.
+    int events() const;
+
+    PollTask* read;
+    PollTask* write;
+  };
+
   struct Task;
 
+  static const int kPriorities = BACKGROUND + 1;
+  static const int kSpinProbeInterval = 64;
+
+  // The ready tasks of a priority that have been taken from |pending_|.
+  struct Lane {
+    Lane() : first(NULL), last(NULL), size(0), skipped(0) {}
+
+    Task* first;
+    Task* last;
+    size_t size;
+    // The tasks of higher priorities that ran while this wasn't empty.
+    int skipped;
+  };
+
   EventLoop();
 
-  static bool SetCurrent(EventLoop* loop);
-  void PingPipe();
+  static thread_local EventLoop* current_;
+
+  static void SetCurrent(EventLoop* loop);
+  void InsertPendingDelayed();
+  void CancelDelayed(DelayedTask* delayed, uint64 id);
+  void DeleteDelayed(DelayedTask* delayed);
+  void AddPollTask(PollTask* task);
+  void InsertPendingPoll();
+  void RegisterPollTask(PollTask* task);
+  void ReleasePollTask(PollTask* task);
+  // Returns NULL if |fd| never had tasks. GetFdState() adds it if needed.
+  FdState* FindFdState(int fd);
+  FdState& GetFdState(int fd);
+  void UpdatePoller(int fd, int old_events);
+  void DispatchPolled(int fd, PollTask* FdState::*slot, int revents);
+  void StopWatch(uint64 id);
+  void RemoveWatcher(uint64 id);
+  void PushTasks(Task* first, Task* last, size_t count, Priority priority);
+  void Wakeup();
+  void FlushWakeup();
+  void TakePending(int priority);
+  void AppendReady(Task* task);
+  Task* NextReadyTask();
+  bool RunReadyTasks();
+  bool OverBudget() const;
+  uint32 task_sampling_interval() const {
+    return task_sampling_interval_.load(std::memory_order_relaxed);
+  }
+  bool HasPendingWork();
+  bool Spin(uint64 start, const PreciseTimeDelta& next_delayed,
+            std::vector<Poller::Event>* events);
+  void UpdateSpinWindow(uint64 idle_nanos, bool hit);
+  bool PollAndDispatch(const PreciseTimeDelta& timeout,
+                       std::vector<Poller::Event>* events);
+  void DispatchEvents(const std::vector<Poller::Event>& events);
   void HandleAndDelete(Task* task);
   void HandleAndDeletePolled(PollTask* task, int revents);
+  void RunWatcher(PollTask* task, int revents);
+  void StartIo(IoTask* task);
+  void WaitForIo(IoTask* task);
+  void PerformIo(IoTask* task, bool nval, bool hup, bool err);
+  void CancelIo(int fd);
+  void CompleteIo(IoTask* task, int result);
+
+  // Storage for the tasks. Any thread can allocate, but only the loop frees.
+  SlabAllocator task_allocator_;
+  SlabAllocator poll_task_allocator_;
+  SlabAllocator delayed_task_allocator_;
+  SlabAllocator io_task_allocator_;
 
-  // These are protected by |pending_lock_|.
-  std::vector<Task*> pending_;
-  std::priority_queue<DelayedTask> pending_delayed_;
+  // Tasks ready to run, per priority. Producers push without locking.
+  MPSCQueue<Task> pending_[kPriorities];
+  // See pending_tasks().
+  std::atomic<size_t> pending_tasks_;
+
+  // Delayed tasks that haven't been added to |timers_| yet.
+  MPSCQueue<DelayedTask> pending_delayed_;
+  std::atomic<uint64> next_delayed_id_;
+  std::atomic<uint64> next_watch_id_;
+
+  // This is protected by |pending_lock_|. |has_pending_poll_| is set while
+  // it's not empty, so that the loop can check it without locking.
   std::vector<PollTask*> pending_poll_;
+  std::atomic<bool> has_pending_poll_;
+
+  // These are only used by the thread running the loop.
+  Lane lanes_[kPriorities];
+  Histogram queue_depth_;
+  Histogram task_latency_;
+  Histogram task_run_time_;
+  Histogram poll_time_;
+  Histogram ready_fds_;
+  Histogram spin_time_;
+  std::atomic<uint64> spin_hits_;
+  int starvation_ratio_;
+  size_t budget_tasks_;
+  TimeDelta budget_time_;
+  size_t tasks_since_poll_;
+  Time last_poll_;
+  // See SetBusyPoll(). |spin_window_| is in nanoseconds, like
+  // |idle_average_|.
+  PreciseTimeDelta max_spin_;
+  int64 idle_average_;
+  uint64 spin_misses_;
+  std::atomic<uint64> spin_window_;
+  // See SetTaskSampling(). Posting threads read the interval too, and count
+  // the tasks they post on their own.
+  std::atomic<uint32> task_sampling_interval_;
+  uint32 due_samples_;
+  uint32 run_samples_;
+  unique_ptr<Poller> poller_;
+  // Indexed by descriptor. Entries stay when their tasks are done, so that
+  // waiting for the same descriptors again doesn't allocate.
+  std::vector<FdState> fd_states_;
+  std::unordered_map<uint64, PollTask*> watchers_;
+  std::vector<PollTask*> inserting_poll_;
+  // PollTasks released while dispatching ready descriptors; they are deleted
+  // once that is done, since other ready events may still point to them.
+  bool dispatching_;
+  std::vector<PollTask*> released_poll_;
+  // The ticks of |timers_| are microseconds.
+  TimerWheel timers_;
+  // The operations that haven't completed yet, linked in a list.
+  IoTask* io_tasks_;
 
   Lock pending_lock_;
-  int pipe_read_;
-  int pipe_write_;
 
-  volatile bool quit_soon_;
+  // Writing to |wakeup_write_| makes |wakeup_read_| readable and wakes up the
+  // loop. Both are the same eventfd on linux, and a pipe elsewhere.
+  int wakeup_read_;
+  int wakeup_write_;
+
+  // True while the loop is awake and will look for new work before blocking
+  // again, or when a wakeup is already on its way. Producers only write to
+  // |wakeup_write_| when they flip it from false.
+  std::atomic<bool> wakeup_pending_;
+
+  std::atomic<bool> quit_soon_;
 #ifndef NDEBUG
   bool running_;
 #endif
@@ -81,4 +409,59 @@ class EventLoop {
   DISALLOW_COPY_AND_ASSIGN(EventLoop);
 };
 
+// Collects tasks for a loop and posts them together, so that each flush costs
+// one synchronization and at most one wakeup instead of one per task. A Batch
+// is flushed when it holds |max_size| tasks, once its first task is
+// |max_delay| old, on Flush(), and when deleted. A zero |max_delay| disables
+// the time limit.
+//
+// The time limit is enforced by a timer on the EventLoop that is current when
+// the first task is added. On threads without one it is only checked when
+// more tasks are added, so producers that can go quiet must Flush() them.
+//
+// A Batch must only be used on the thread that created it. Producers that
+// post from several threads need one per thread, e.g. a thread_local one.
+// Batches post to |loop| when deleted, so a thread_local one must be flushed
+// and never used again before |loop| is deleted, or |loop| must outlive the
+// threads that use it.
+class EventLoop::Batch {
+ public:
+  static const size_t kDefaultMaxSize = 64;
+
+  explicit Batch(EventLoop* loop, size_t max_size = kDefaultMaxSize,
+                 const TimeDelta& max_delay = TimeDelta(1),
+                 Priority priority = NORMAL);
+  ~Batch();
+
+  void Post(Callback&& f);
+  void Flush();
+
+  size_t size() const { return size_; }
+
+ private:
+  // Posts a flush to the current loop after |delay|, if there is one.
+  void ArmFlushTimer(const PreciseTimeDelta& delay);
+  void OnFlushTimer();
+
+  EventLoop* loop_;
+  size_t max_size_;
+  TimeDelta max_delay_;
+  Priority priority_;
+
+  // The tasks collected so far, linked through their |next|.
+  Task* first_;
+  Task* last_;
+  size_t size_;
+  Time first_time_;
+  bool timer_armed_;
+
+#ifndef NDEBUG
+  ThreadChecker checker_;
+#endif
+
+  ScopedWeakPtrFactory<Batch> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(Batch);
+};
+
 #endif  // BASE_EVENT_LOOP_H
@@ -0,0 +1,444 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/future.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// Raises the soft limit of open descriptors so that |count| more can be
+// opened. Returns false if the hard limit is too low.
+bool EnsureDescriptorLimit(size_t count) {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    return false;
+  rlim_t wanted = count + 64;
+  if (limit.rlim_cur >= wanted)
+    return true;
+  if (limit.rlim_max < wanted)
+    return false;
+  limit.rlim_cur = wanted;
+  return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+}
+
+// Returns a descriptor that never becomes readable, or -1.
+int OpenIdleDescriptor() {
+#if defined(__linux__)
+  return eventfd(0, EFD_CLOEXEC);
+#else
+  int fds[2];
+  if (pipe(fds) != 0)
+    return -1;
+  // The write end is leaked on purpose; the read end never gets data.
+  return fds[0];
+#endif
+}
+
+void Ignore(bool nval, bool hup, bool err) {}
+
+void ReadAndQuit(EventLoop* loop, int fd, bool nval, bool hup, bool err) {
+  uint8 byte;
+  if (read(fd, &byte, 1) != 1)
+    LOG(FATAL) << "read failed";
+  loop->QuitSoon();
+}
+
+// Measures a wakeup for a single ready descriptor while |state.range(0)| other
+// descriptors are registered but idle.
+void BM_WakeupWithIdleDescriptors(benchmark::State& state,
+                                  Poller::Backend backend) {
+  const size_t idle_count = state.range(0);
+  if (!EnsureDescriptorLimit(idle_count)) {
+    state.SkipWithError("RLIMIT_NOFILE is too low");
+    return;
+  }
+
+  unique_ptr<EventLoop> loop = EventLoop::Create(backend);
+  if (!loop) {
+    state.SkipWithError("backend not available");
+    return;
+  }
+
+  std::vector<int> idle;
+  for (size_t i = 0; i < idle_count; ++i) {
+    int fd = OpenIdleDescriptor();
+    if (fd == -1)
+      break;
+    idle.push_back(fd);
+    loop->PostWhenReadReady(fd, Bind(Ignore));
+  }
+
+  int fds[2];
+  if (idle.size() != idle_count || pipe(fds) != 0) {
+    state.SkipWithError("failed to open descriptors");
+  } else {
+    for (auto _: state) {
+      uint8 byte = 0;
+      if (write(fds[1], &byte, 1) != 1)
+        LOG(FATAL) << "write failed";
+      loop->PostWhenReadReady(fds[0], Bind(ReadAndQuit, loop.get(), fds[0]));
+      loop->Run();
+    }
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  for (int fd: idle)
+    loop->CancelDescriptor(fd);
+  loop->QuitSoon();
+  loop->Run();
+  for (int fd: idle)
+    close(fd);
+}
+
+void Nothing() {}
+
+void ArmAndCancel(EventLoop* loop, int count,
+                  std::vector<EventLoop::TimerHandle>* handles) {
+  for (int i = 0; i < count; ++i)
+    handles->push_back(loop->PostAfter(Bind(Nothing), TimeDelta(30000 + i)));
+  for (EventLoop::TimerHandle& handle: *handles)
+    handle.Cancel();
+  handles->clear();
+  loop->QuitSoon();
+}
+
+// Measures arming and cancelling |state.range(0)| delayed tasks on the loop
+// thread, like timeouts that almost never fire.
+void BM_PostAfterAndCancel(benchmark::State& state) {
+  const int count = state.range(0);
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  std::vector<EventLoop::TimerHandle> handles;
+  handles.reserve(count);
+  for (auto _: state) {
+    loop->Post(Bind(ArmAndCancel, loop.get(), count, &handles));
+    loop->Run();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Measures how long a delayed task of |state.range(0)| microseconds takes to
+// run on an idle loop; the excess over the delay is the timer's slack.
+void BM_PostAfterDelay(benchmark::State& state, Poller::Backend backend) {
+  unique_ptr<EventLoop> loop = EventLoop::Create(backend);
+  if (!loop) {
+    state.SkipWithError("backend not available");
+    return;
+  }
+  for (auto _: state) {
+    loop->PostAfter(Bind(&EventLoop::QuitSoon, loop.get()),
+                    PreciseTimeDelta(state.range(0)));
+    loop->Run();
+  }
+}
+
+struct Reader {
+  EventLoop* loop;
+  int fd;
+  int remaining;
+  bool watching;
+  EventLoop::WatchHandle handle;
+};
+
+void ReadOne(Reader* reader, bool nval, bool hup, bool err) {
+  uint8 byte;
+  if (read(reader->fd, &byte, 1) != 1)
+    LOG(FATAL) << "read failed";
+  if (--reader->remaining == 0) {
+    reader->handle.Stop();
+    reader->loop->QuitSoon();
+  } else if (!reader->watching)
+    reader->loop->PostWhenReadReady(reader->fd, Bind(ReadOne, reader));
+}
+
+// Measures receiving |state.range(0)| messages on a descriptor, either by
+// posting a new PollTask after each one or with a single watcher.
+void BM_ReadMessages(benchmark::State& state, bool watch) {
+  const int count = state.range(0);
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  int fds[2];
+  if (pipe(fds) != 0) {
+    state.SkipWithError("pipe failed");
+    return;
+  }
+  std::vector<uint8> bytes(count);
+  for (auto _: state) {
+    if (write(fds[1], &bytes[0], count) != count)
+      LOG(FATAL) << "write failed";
+    Reader reader = { loop.get(), fds[0], count, watch,
+                      EventLoop::WatchHandle() };
+    if (watch)
+      reader.handle = loop->WatchReadable(fds[0], Bind(ReadOne, &reader));
+    else
+      loop->PostWhenReadReady(fds[0], Bind(ReadOne, &reader));
+    loop->Run();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+struct OperationReader {
+  EventLoop* loop;
+  int fd;
+  int remaining;
+  uint8 byte;
+};
+
+void ReadNext(OperationReader* reader, int result) {
+  if (result != 1)
+    LOG(FATAL) << "read failed: " << result;
+  if (--reader->remaining == 0)
+    reader->loop->QuitSoon();
+  else
+    reader->loop->PostRead(reader->fd, &reader->byte, 1,
+                           Bind(ReadNext, reader));
+}
+
+void StartReading(OperationReader* reader) {
+  reader->loop->PostRead(reader->fd, &reader->byte, 1, Bind(ReadNext, reader));
+}
+
+// Like BM_ReadMessages, but with a PostRead() per message. io_uring completes
+// the reads in the kernel; the other backends wait for readiness and read.
+void BM_ReadOperations(benchmark::State& state, Poller::Backend backend) {
+  const int count = state.range(0);
+  unique_ptr<EventLoop> loop = EventLoop::Create(backend);
+  if (!loop) {
+    state.SkipWithError("backend not available");
+    return;
+  }
+  int fds[2];
+  if (pipe(fds) != 0) {
+    state.SkipWithError("pipe failed");
+    return;
+  }
+  std::vector<uint8> bytes(count);
+  for (auto _: state) {
+    if (write(fds[1], &bytes[0], count) != count)
+      LOG(FATAL) << "write failed";
+    OperationReader reader = { loop.get(), fds[0], count, 0 };
+    loop->Post(Bind(StartReading, &reader));
+    loop->Run();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void CountTask(std::atomic<int>* counter) {
+  counter->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Measures posting to a loop running on another thread, in batches of
+// |state.range(0)| tasks. Batches of 1 are like calling Post().
+void BM_PostBatch(benchmark::State& state) {
+  const size_t batch_size = state.range(0);
+  const int kTasks = 4096;
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  std::thread runner(Bind(&EventLoop::Run, loop.get()));
+  std::atomic<int> counter(0);
+  int expected = 0;
+  for (auto _: state) {
+    {
+      EventLoop::Batch batch(loop.get(), batch_size, TimeDelta());
+      for (int i = 0; i < kTasks; ++i)
+        batch.Post(Bind(CountTask, &counter));
+    }
+    expected += kTasks;
+    while (counter.load() != expected)
+      std::this_thread::yield();
+  }
+  loop->QuitSoon();
+  runner.join();
+  state.SetItemsProcessed(state.iterations() * kTasks);
+}
+
+// Measures posting to a loop running on another thread from one or more
+// threads at once, each waiting for its own tasks to run.
+void BM_PostFromThreads(benchmark::State& state) {
+  const int kTasks = 1024;
+  static EventLoop* loop;
+  static std::thread* runner;
+  if (state.thread_index() == 0) {
+    loop = EventLoop::Create().release();
+    runner = new std::thread(Bind(&EventLoop::Run, loop));
+  }
+  std::atomic<int> counter(0);
+  int expected = 0;
+  for (auto _: state) {
+    for (int i = 0; i < kTasks; ++i)
+      loop->Post(Bind(CountTask, &counter));
+    expected += kTasks;
+    while (counter.load() != expected)
+      std::this_thread::yield();
+  }
+  state.SetItemsProcessed(state.iterations() * kTasks);
+  if (state.thread_index() == 0) {
+    loop->QuitSoon();
+    runner->join();
+    delete runner;
+    delete loop;
+  }
+}
+
+void Pong(EventLoop* origin) {
+  origin->QuitSoon();
+}
+
+// Measures a round trip from a loop to one running on another thread and
+// back, with both loops blocking in between.
+void BM_PingPong(benchmark::State& state) {
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  unique_ptr<EventLoop> other = EventLoop::Create();
+  std::thread runner(Bind(&EventLoop::Run, other.get()));
+  for (auto _: state) {
+    other->Post(Bind(Pong, loop.get()));
+    loop->Run();
+  }
+  other->QuitSoon();
+  runner.join();
+  state.SetItemsProcessed(state.iterations());
+}
+
+int AddOne(int value) {
+  return value + 1;
+}
+
+void HopWithPost(EventLoop* loops[2], int hops, int value,
+                 std::atomic<int>* result) {
+  if (!hops) {
+    result->store(value);
+    return;
+  }
+  loops[hops % 2]->Post(
+      Bind(HopWithPost, loops, hops - 1, value + 1, result));
+}
+
+// Measures requests that hop |state.range(0)| times between two loops running
+// on other threads, passing a value along, with plain posts and with Futures.
+void BM_CrossLoopHops(benchmark::State& state, bool futures) {
+  const int hops = state.range(0);
+  unique_ptr<EventLoop> first = EventLoop::Create();
+  unique_ptr<EventLoop> second = EventLoop::Create();
+  EventLoop* loops[2] = { first.get(), second.get() };
+  std::thread first_runner(Bind(&EventLoop::Run, first.get()));
+  std::thread second_runner(Bind(&EventLoop::Run, second.get()));
+  std::atomic<int> result(0);
+  for (auto _: state) {
+    result = 0;
+    if (futures) {
+      // The chain is built before the value is set, like a pipeline set up
+      // ahead of a reply.
+      Promise<int> promise;
+      Future<int> future = promise.future();
+      for (int i = hops; i > 0; --i)
+        future = future.Then(loops[i % 2], Bind(AddOne));
+      future.Then(loops[0], [&result](int value) { result.store(value); });
+      promise.SetValue(0);
+    } else {
+      HopWithPost(loops, hops, 0, &result);
+    }
+    while (result.load() != hops)
+      std::this_thread::yield();
+  }
+  first->QuitSoon();
+  second->QuitSoon();
+  first_runner.join();
+  second_runner.join();
+  state.SetItemsProcessed(state.iterations());
+}
+
+void Repost(EventLoop* loop, bool once, int remaining) {
+  if (!remaining)
+    loop->QuitSoon();
+  else if (once)
+    loop->Post(BindOnce(Repost, loop, once, remaining - 1));
+  else
+    loop->Post(Bind(Repost, loop, once, remaining - 1));
+}
+
+// Measures tasks that post their follow-up to their own loop, bound with
+// BindOnce() if |once|, which doesn't allocate, or with Bind().
+void BM_PostFromLoop(benchmark::State& state, bool once) {
+  const int count = state.range(0);
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  for (auto _: state) {
+    loop->Post(Bind(Repost, loop.get(), once, count));
+    loop->Run();
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+// Measures handing a task to a loop running on another thread and seeing it
+// run, with the loop blocking in between or busy polling for up to
+// |state.range(0)| microseconds.
+void BM_Handoff(benchmark::State& state) {
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  loop->SetBusyPoll(PreciseTimeDelta(state.range(0)));
+  std::thread runner(Bind(&EventLoop::Run, loop.get()));
+  std::atomic<int> counter(0);
+  int expected = 0;
+  for (auto _: state) {
+    loop->Post(Bind(CountTask, &counter));
+    ++expected;
+    while (counter.load() != expected)
+      std::this_thread::yield();
+  }
+  loop->QuitSoon();
+  runner.join();
+  EventLoop::RuntimeStats stats = loop->runtime_stats();
+  state.counters["spin_hits"] = stats.spin_hits;
+  state.counters["spin_cpu_us"] = stats.spin_time.sum / 1000.0;
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_PostFromLoop, bind, false)->Arg(10000);
+BENCHMARK_CAPTURE(BM_PostFromLoop, bind_once, true)->Arg(10000);
+BENCHMARK(BM_Handoff)->Arg(0)->Arg(50)->UseRealTime();
+BENCHMARK(BM_PostFromThreads)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_PingPong)->UseRealTime();
+
+BENCHMARK_CAPTURE(BM_CrossLoopHops, post, false)->Arg(5)->UseRealTime();
+BENCHMARK_CAPTURE(BM_CrossLoopHops, future, true)->Arg(5)->UseRealTime();
+
+BENCHMARK(BM_PostBatch)->Arg(1)->Arg(16)->Arg(256)->UseRealTime();
+
+BENCHMARK_CAPTURE(BM_ReadMessages, oneshot, false)->Arg(1000);
+BENCHMARK_CAPTURE(BM_ReadMessages, watch, true)->Arg(1000);
+
+#if defined(__linux__)
+BENCHMARK_CAPTURE(BM_ReadOperations, epoll, Poller::EPOLL)->Arg(1000);
+BENCHMARK_CAPTURE(BM_ReadOperations, io_uring, Poller::IO_URING)->Arg(1000);
+#endif
+
+BENCHMARK(BM_PostAfterAndCancel)->Arg(1000)->Arg(100000);
+
+BENCHMARK_CAPTURE(BM_PostAfterDelay, poll, Poller::POLL)
+    ->Arg(50)->Arg(200)->UseRealTime();
+#if defined(__linux__)
+BENCHMARK_CAPTURE(BM_PostAfterDelay, epoll, Poller::EPOLL)
+    ->Arg(50)->Arg(200)->UseRealTime();
+BENCHMARK_CAPTURE(BM_PostAfterDelay, io_uring, Poller::IO_URING)
+    ->Arg(50)->Arg(200)->UseRealTime();
+#endif
+
+BENCHMARK_CAPTURE(BM_WakeupWithIdleDescriptors, poll, Poller::POLL)
+    ->Arg(10000)->Arg(50000)->Arg(100000);
+#if defined(__linux__)
+BENCHMARK_CAPTURE(BM_WakeupWithIdleDescriptors, epoll, Poller::EPOLL)
+    ->Arg(10000)->Arg(50000)->Arg(100000);
+BENCHMARK_CAPTURE(BM_WakeupWithIdleDescriptors, io_uring, Poller::IO_URING)
+    ->Arg(10000)->Arg(50000)->Arg(100000);
+#endif
@@ -0,0 +1,126 @@
+#include "base/event_loop_group.h"
+
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+
+namespace {
+
+// Returns the CPUs that the process can run on.
+std::vector<int> available_cpus() {
+  std::vector<int> cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set))
+        cpus.push_back(cpu);
+    }
+  } else {
+    DLOGE(ERROR) << "sched_getaffinity failed";
+  }
+#endif
+  if (cpus.empty()) {
+    unsigned count = std::thread::hardware_concurrency();
+    for (unsigned cpu = 0; cpu < (count ? count : 1); ++cpu)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+}  // namespace
+
+EventLoopGroup::EventLoopGroup()
+    : policy_(ROUND_ROBIN),
+      next_(0) {}
+
+EventLoopGroup::~EventLoopGroup() {
+  Shutdown();
+}
+
+// static
+unique_ptr<EventLoopGroup> EventLoopGroup::Create(const Options& options) {
+  std::vector<int> cpus = available_cpus();
+  size_t size = options.size ? options.size : cpus.size();
+
+  unique_ptr<EventLoopGroup> group(new EventLoopGroup);
+  group->policy_ = options.policy;
+  for (size_t i = 0; i < size; ++i) {
+    unique_ptr<EventLoop> loop = EventLoop::Create(options.backend);
+    if (!loop)
+      return NULL;
+    group->loops_.push_back(std::move(loop));
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    int cpu = options.pin_threads ? cpus[i % cpus.size()] : -1;
+    std::string name;
+    if (!options.name.empty())
+      name = options.name + std::to_string(i);
+    group->threads_.push_back(std::thread(
+        Bind(&EventLoopGroup::RunLoop, group->loops_[i].get(), cpu, name)));
+  }
+  return group;
+}
+
+EventLoop* EventLoopGroup::Next() {
+  size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+  if (policy_ == ROUND_ROBIN)
+    return loops_[start % loops_.size()].get();
+
+  // Ties go to the loops in round robin order.
+  EventLoop* best = NULL;
+  uint64 best_load = kuint64max;
+  for (size_t i = 0; i < loops_.size(); ++i) {
+    EventLoop* loop = loops_[(start + i) % loops_.size()].get();
+    uint64 load = LoadOf(loop);
+    if (load < best_load) {
+      best = loop;
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+// static
+uint64 EventLoopGroup::LoadOf(EventLoop* loop) {
+  return loop->pending_tasks();
+}
+
+void EventLoopGroup::Shutdown() {
+  if (threads_.empty())
+    return;
+  // Posting the quit keeps it behind the tasks posted so far.
+  for (unique_ptr<EventLoop>& loop: loops_)
+    loop->Post(Bind(&EventLoop::QuitSoon, loop.get()));
+  for (std::thread& thread: threads_)
+    thread.join();
+  threads_.clear();
+}
+
+// static
+void EventLoopGroup::RunLoop(EventLoop* loop, int cpu,
+                             const std::string& name) {
+#if defined(__linux__)
+  int ret;
+  if (!name.empty()) {
+    if ((ret = pthread_setname_np(pthread_self(), name.substr(0, 15).c_str())))
+      DLOG(WARNING) << "pthread_setname_np failed: " << ret;
+  }
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if ((ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)))
+      DLOG(WARNING) << "pthread_setaffinity_np failed: " << ret;
+  }
+#endif
+  loop->Run();
+}
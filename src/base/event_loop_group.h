@@ -0,0 +1,84 @@
+#ifndef BASE_EVENT_LOOP_GROUP_H
+#define BASE_EVENT_LOOP_GROUP_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+#include "base/memory.h"
+#include "base/poller.h"
+
+class EventLoop;
+
+// A set of EventLoops, each running on its own thread. Work can be spread
+// over the loops by posting to Next(), e.g. to handle each accepted connection
+// on a different loop.
+class EventLoopGroup {
+ public:
+  enum Policy {
+    // Cycles through the loops.
+    ROUND_ROBIN,
+    // Picks the loop with the fewest pending tasks.
+    LEAST_LOADED,
+  };
+
+  struct Options {
+    Options()
+        : size(0),
+          backend(Poller::DEFAULT),
+          policy(ROUND_ROBIN),
+          pin_threads(false) {}
+
+    // The number of loops. Zero means one per CPU available to the process.
+    size_t size;
+    Poller::Backend backend;
+    Policy policy;
+    // Pins the thread of the i-th loop to the i-th available CPU, wrapping
+    // around. Only supported on linux. Off by default, since every group
+    // that pins starts from the same CPUs.
+    bool pin_threads;
+    // If not empty, the threads are named |name| followed by their index.
+    // Linux truncates thread names to 15 characters.
+    std::string name;
+  };
+
+  // Returns a new group with its loops already running, or NULL if a loop or
+  // thread can't be created.
+  static unique_ptr<EventLoopGroup> Create(const Options& options);
+
+  // Shuts down the group if that wasn't done yet.
+  ~EventLoopGroup();
+
+  size_t size() const { return loops_.size(); }
+  EventLoop* loop(size_t index) const { return loops_[index].get(); }
+
+  // Returns the loop to post the next unit of work to, according to the
+  // policy of the group. Can be called from any thread.
+  EventLoop* Next();
+
+  // Returns the approximate number of tasks pending in |loop|. See
+  // EventLoop::pending_tasks().
+  static uint64 LoadOf(EventLoop* loop);
+
+  // Lets every loop run the tasks that are already ready, then quits them and
+  // joins their threads. The loops are kept until the group is deleted, so
+  // they can still be posted to; but their tasks won't run. Must not be
+  // called from one of the group's loops.
+  void Shutdown();
+
+ private:
+  EventLoopGroup();
+
+  static void RunLoop(EventLoop* loop, int cpu, const std::string& name);
+
+  std::vector<unique_ptr<EventLoop>> loops_;
+  std::vector<std::thread> threads_;
+  Policy policy_;
+  std::atomic<size_t> next_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventLoopGroup);
+};
+
+#endif  // BASE_EVENT_LOOP_GROUP_H
@@ -0,0 +1,111 @@
+#include "base/event_loop_group.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/unittest.h"
+
+namespace {
+
+struct ThreadInfo {
+  EventLoop* loop;
+  std::thread::id id;
+  std::string name;
+};
+
+void record_thread(ThreadInfo* info) {
+  info->loop = EventLoop::Current();
+  info->id = std::this_thread::get_id();
+#if defined(__linux__)
+  char name[16];
+  if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+    info->name = name;
+#endif
+}
+
+void increment_atomic(std::atomic<int>* counter) {
+  (*counter)++;
+}
+
+void wait_for(std::atomic<bool>* flag) {
+  while (!*flag)
+    std::this_thread::sleep_for(TimeDelta(1));
+}
+
+}  // namespace
+
+TEST(EventLoopGroup, RoundRobin) {
+  EventLoopGroup::Options options;
+  options.size = 3;
+  options.name = "group";
+  unique_ptr<EventLoopGroup> group = EventLoopGroup::Create(options);
+  ASSERT_TRUE(group.get());
+  ASSERT_EQ(3u, group->size());
+
+  std::vector<ThreadInfo> info(3);
+  for (size_t i = 0; i < 3; ++i) {
+    EventLoop* loop = group->Next();
+    EXPECT_EQ(group->loop(i), loop);
+    loop->Post(Bind(record_thread, &info[i]));
+  }
+  EXPECT_EQ(group->loop(0), group->Next());
+  group->Shutdown();
+
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(group->loop(i), info[i].loop);
+    EXPECT_NE(std::this_thread::get_id(), info[i].id);
+#if defined(__linux__)
+    EXPECT_EQ("group" + std::to_string(i), info[i].name);
+#endif
+  }
+  EXPECT_NE(info[0].id, info[1].id);
+  EXPECT_NE(info[1].id, info[2].id);
+}
+
+TEST(EventLoopGroup, LeastLoaded) {
+  EventLoopGroup::Options options;
+  options.size = 2;
+  options.policy = EventLoopGroup::LEAST_LOADED;
+  unique_ptr<EventLoopGroup> group = EventLoopGroup::Create(options);
+  ASSERT_TRUE(group.get());
+
+  // The first loop is busy, and has a backlog.
+  std::atomic<bool> release(false);
+  std::atomic<int> counter(0);
+  EventLoop* busy = group->loop(0);
+  busy->Post(Bind(wait_for, &release));
+  for (int i = 0; i < 10; ++i)
+    busy->Post(Bind(increment_atomic, &counter));
+  EXPECT_LE(10u, EventLoopGroup::LoadOf(busy));
+
+  for (int i = 0; i < 5; ++i)
+    EXPECT_EQ(group->loop(1), group->Next());
+
+  release = true;
+  group->Shutdown();
+  EXPECT_EQ(10, counter);
+  EXPECT_EQ(0u, EventLoopGroup::LoadOf(busy));
+}
+
+TEST(EventLoopGroup, Shutdown) {
+  unique_ptr<EventLoopGroup> group =
+      EventLoopGroup::Create(EventLoopGroup::Options());
+  ASSERT_TRUE(group.get());
+  EXPECT_LE(1u, group->size());
+
+  // The tasks that are ready when shutting down still run.
+  std::atomic<int> counter(0);
+  for (int i = 0; i < 1000; ++i)
+    group->Next()->Post(Bind(increment_atomic, &counter));
+  group->Shutdown();
+  EXPECT_EQ(1000, counter);
+
+  // Shutting down again does nothing.
+  group->Shutdown();
+}
@@ -1,8 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "base/event_loop.h"
+#include "base/socket.h"
 #include "base/time.h"
 #include "base/unittest.h"
 #include "base/weak.h"
@@ -48,10 +59,11 @@ Time return_current_time(const Time* t) {
 
 }  // namespace
 
-class EventLoopTest : public testing::Test {
+// Runs each test with every Poller backend available.
+class EventLoopTest : public testing::TestWithParam<Poller::Backend> {
  public:
   EventLoopTest()
-      : loop_(EventLoop::Create()) {}
+      : loop_(EventLoop::Create(GetParam())) {}
 
   void SetUp() override {
     SetNowFunction(Bind(return_current_time, &now_));
@@ -77,7 +89,10 @@ class EventLoopTest : public testing::Test {
   unique_ptr<EventLoop> loop_;
 };
 
-TEST_F(EventLoopTest, QuitAfterAllWorkDone) {
+INSTANTIATE_TEST_CASE_P(Backends, EventLoopTest,
+                        testing::ValuesIn(AvailablePollerBackends()));
+
+TEST_P(EventLoopTest, QuitAfterAllWorkDone) {
   int counter = 0;
   loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
   loop_->Post(Bind(verify_current, loop_.get()));
@@ -88,7 +103,7 @@ TEST_F(EventLoopTest, QuitAfterAllWorkDone) {
   EXPECT_EQ(1, counter);
 }
 
-TEST_F(EventLoopTest, WakeUpForWork) {
+TEST_P(EventLoopTest, WakeUpForWork) {
   int counter = 0;
   std::thread other(Bind(&EventLoop::Run, loop_.get()));
   std::this_thread::sleep_for(TimeDelta(1));
@@ -98,7 +113,43 @@ TEST_F(EventLoopTest, WakeUpForWork) {
   EXPECT_EQ(1, counter);
 }
 
-TEST_F(EventLoopTest, WeakPtr) {
+namespace {
+
+void increment_atomic(std::atomic<int>* counter) {
+  (*counter)++;
+}
+
+void post_increments(EventLoop* loop, std::atomic<int>* counter, int count) {
+  for (int i = 0; i < count; ++i)
+    loop->Post(Bind(increment_atomic, counter));
+}
+
+void quit_when(EventLoop* loop, std::atomic<int>* counter, int expected) {
+  if (*counter == expected)
+    loop->QuitSoon();
+  else
+    loop->Post(Bind(quit_when, loop, counter, expected));
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, WakeUpFromManyThreads) {
+  const int kThreads = 4;
+  const int kTasks = 10000;
+  std::atomic<int> counter(0);
+  std::thread runner(Bind(&EventLoop::Run, loop_.get()));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread(Bind(post_increments, loop_.get(), &counter,
+                                       kTasks)));
+  for (std::thread& t: threads)
+    t.join();
+  loop_->Post(Bind(quit_when, loop_.get(), &counter, kThreads * kTasks));
+  runner.join();
+  EXPECT_EQ(kThreads * kTasks, counter);
+}
+
+TEST_P(EventLoopTest, WeakPtr) {
   int counter = 0;
   WeakIncrementer incrementer(&counter);
   WeakPtr<Incrementer> ptr;
@@ -130,7 +181,7 @@ TEST_F(EventLoopTest, WeakPtr) {
   EXPECT_EQ(3, counter);
 }
 
-TEST_F(EventLoopTest, After) {
+TEST_P(EventLoopTest, After) {
   Time start;
   now_ = start;
   int counter = 0;
@@ -186,7 +237,7 @@ TEST_F(EventLoopTest, After) {
   EXPECT_EQ(1, delayedCounterC);
 }
 
-TEST_F(EventLoopTest, ReadWrite) {
+TEST_P(EventLoopTest, ReadWrite) {
   Time start;
   now_ = start;
   Time end = start + TimeDelta(10);
@@ -214,7 +265,7 @@ TEST_F(EventLoopTest, ReadWrite) {
   close(fds[1]);
 }
 
-TEST_F(EventLoopTest, ClosedFd) {
+TEST_P(EventLoopTest, ClosedFd) {
   Time start;
   now_ = start;
   Time end = start + TimeDelta(10);
@@ -241,8 +292,8 @@ TEST_F(EventLoopTest, ClosedFd) {
   close(fds[1]);
 }
 
-TEST_F(EventLoopTest, Current) {
-  unique_ptr<EventLoop> loop2(EventLoop::Create());
+TEST_P(EventLoopTest, Current) {
+  unique_ptr<EventLoop> loop2(EventLoop::Create(GetParam()));
   ASSERT_TRUE(loop2.get());
   int counter = 0;
   int counter2 = 0;
@@ -259,8 +310,8 @@ TEST_F(EventLoopTest, Current) {
   EXPECT_EQ(1, counter2);
 }
 
-TEST_F(EventLoopTest, PostAndReply) {
-  unique_ptr<EventLoop> loop2(EventLoop::Create());
+TEST_P(EventLoopTest, PostAndReply) {
+  unique_ptr<EventLoop> loop2(EventLoop::Create(GetParam()));
   ASSERT_TRUE(loop2.get());
 
   int task_counter = 0;
@@ -268,7 +319,8 @@ TEST_F(EventLoopTest, PostAndReply) {
 
   auto task = Bind(increment, &task_counter);
   auto reply = Bind(increment, &reply_counter);
-  auto both = Bind(&EventLoop::PostAndReply, loop2.get(), task, reply);
+  auto both = Bind(&EventLoop::PostAndReply, loop2.get(), task, reply,
+                   EventLoop::NORMAL);
 
   loop_->Post(both);
   loop_->QuitSoon();
@@ -300,7 +352,7 @@ class ScopedFlag {
 
 }  // namespace
 
-TEST_F(EventLoopTest, DeleteSoon) {
+TEST_P(EventLoopTest, DeleteSoon) {
   bool flag = true;
   ScopedFlag* scoped_flag = new ScopedFlag(&flag);
   EXPECT_TRUE(flag);
@@ -311,3 +363,982 @@ TEST_F(EventLoopTest, DeleteSoon) {
   loop_->Run();
   EXPECT_FALSE(flag);
 }
+
+namespace {
+
+void record_fd(std::vector<int>* fds, int fd, bool nval, bool hup, bool err) {
+  fds->push_back(fd);
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, ManyDescriptors) {
+  const int kPipes = 64;
+  int fds[kPipes][2];
+  int quit[2];
+  ASSERT_EQ(0, pipe(quit));
+  std::vector<int> ready;
+  for (int i = 0; i < kPipes; ++i) {
+    ASSERT_EQ(0, pipe(fds[i]));
+    loop_->PostWhenReadReady(fds[i][0], Bind(record_fd, &ready, fds[i][0]));
+  }
+
+  // Only the written pipes become ready.
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds[3][1], &byte, 1));
+  ASSERT_EQ(1, write(fds[40][1], &byte, 1));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  std::sort(ready.begin(), ready.end());
+  ASSERT_EQ(2u, ready.size());
+  EXPECT_EQ(fds[3][0], ready[0]);
+  EXPECT_EQ(fds[40][0], ready[1]);
+
+  // The others are still registered.
+  ready.clear();
+  ASSERT_EQ(1, write(fds[63][1], &byte, 1));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  ASSERT_EQ(1u, ready.size());
+  EXPECT_EQ(fds[63][0], ready[0]);
+
+  for (int i = 0; i < kPipes; ++i) {
+    loop_->CancelDescriptor(fds[i][0]);
+    close(fds[i][1]);
+  }
+  ready.clear();
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_TRUE(ready.empty());
+  for (int i = 0; i < kPipes; ++i)
+    close(fds[i][0]);
+  close(quit[0]);
+  close(quit[1]);
+}
+
+TEST_P(EventLoopTest, CancelDescriptor) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  int quit[2];
+  ASSERT_EQ(0, pipe(quit));
+  std::vector<int> ready;
+
+  loop_->PostWhenReadReady(fds[0], Bind(record_fd, &ready, fds[0]));
+  loop_->CancelDescriptor(fds[0]);
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_TRUE(ready.empty());
+
+  // The descriptor can be waited on again.
+  loop_->PostWhenReadReady(fds[0], Bind(record_fd, &ready, fds[0]));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  ASSERT_EQ(1u, ready.size());
+  EXPECT_EQ(fds[0], ready[0]);
+
+  close(fds[0]);
+  close(fds[1]);
+  close(quit[0]);
+  close(quit[1]);
+}
+
+namespace {
+
+void use_shared(std::shared_ptr<int> ptr) {
+  (*ptr)++;
+}
+
+void post_and_cancel(EventLoop* loop, std::shared_ptr<int> ptr) {
+  EventLoop::TimerHandle handle =
+      loop->PostAfter(Bind(use_shared, ptr), TimeDelta(0));
+  EXPECT_EQ(3, ptr.use_count());
+  // The task is released right away on the loop's thread.
+  handle.Cancel();
+  EXPECT_EQ(2, ptr.use_count());
+  // Cancelling again does nothing.
+  handle.Cancel();
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, CancelDelayed) {
+  Time start;
+  now_ = start;
+  std::shared_ptr<int> counter(new int(0));
+
+  loop_->Post(BindOnce(post_and_cancel, loop_.get(), counter));
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(0, *counter);
+  EXPECT_EQ(1, counter.use_count());
+
+  // Cancelled from another thread before it's due.
+  EventLoop::TimerHandle a =
+      loop_->PostAfter(Bind(use_shared, counter), TimeDelta(10));
+  EventLoop::TimerHandle b =
+      loop_->PostAfter(Bind(use_shared, counter), TimeDelta(10));
+  a.Cancel();
+  now_ = start + TimeDelta(10);
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(1, *counter);
+  EXPECT_EQ(1, counter.use_count());
+
+  // Cancelling after it ran does nothing.
+  b.Cancel();
+  EventLoop::TimerHandle().Cancel();
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(1, *counter);
+}
+
+namespace {
+
+void cancel_timer(EventLoop::TimerHandle* handle) {
+  handle->Cancel();
+}
+
+// Starts a timer, and keeps the loop busy until it's due before posting its
+// cancellation.
+void start_timer_and_wait(EventLoop* loop, EventLoop::TimerHandle* handle,
+                          std::shared_ptr<int> ptr, Time* now) {
+  *handle = loop->PostAfter(Bind(use_shared, ptr), TimeDelta(5));
+  *now += TimeDelta(10);
+  loop->Post(Bind(cancel_timer, handle));
+}
+
+void use_shared_and_cancel(std::shared_ptr<int> ptr,
+                           EventLoop::TimerHandle* handle) {
+  (*ptr)++;
+  handle->Cancel();
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, CancelDueDelayed) {
+  Time start;
+  now_ = start;
+  std::shared_ptr<int> counter(new int(0));
+
+  // The timer is due when its cancellation runs, but hasn't run yet.
+  EventLoop::TimerHandle handle;
+  loop_->Post(Bind(start_timer_and_wait, loop_.get(), &handle, counter,
+                   &now_));
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(0, *counter);
+  EXPECT_EQ(1, counter.use_count());
+
+  // Both are due at once, and the first one cancels the second.
+  EventLoop::TimerHandle second;
+  loop_->PostAfter(Bind(cancel_timer, &second), TimeDelta(5));
+  second = loop_->PostAfter(Bind(use_shared, counter), TimeDelta(5));
+  now_ = start + TimeDelta(20);
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(0, *counter);
+  EXPECT_EQ(1, counter.use_count());
+
+  // Cancelling a timer from its own callback does nothing.
+  handle = loop_->PostAfter(Bind(use_shared_and_cancel, counter, &handle),
+                            TimeDelta(5));
+  now_ = start + TimeDelta(30);
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(1, *counter);
+  EXPECT_EQ(1, counter.use_count());
+}
+
+TEST_P(EventLoopTest, ReusesTaskStorage) {
+  int counter = 0;
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      loop_->Post(Bind(increment, &counter));
+      loop_->PostAfter(Bind(increment, &counter), TimeDelta(0));
+    }
+    loop_->QuitSoon();
+    loop_->Run();
+  }
+  EXPECT_EQ(2000, counter);
+
+  EventLoop::AllocationStats stats = loop_->allocation_stats();
+  EXPECT_EQ(2000u, stats.tasks.allocations);
+  EXPECT_EQ(2000u, stats.tasks.frees);
+  EXPECT_EQ(1000u, stats.delayed_tasks.allocations);
+  EXPECT_EQ(1000u, stats.delayed_tasks.frees);
+  // 200 tasks were live at most, so the slabs were allocated on the first
+  // round only.
+  EXPECT_EQ(3u, stats.tasks.slabs);
+  EXPECT_EQ(2u, stats.delayed_tasks.slabs);
+  EXPECT_EQ(0u, stats.poll_tasks.slabs);
+}
+
+namespace {
+
+// Runs |warm_up| rounds of |work| on |loop| and then |rounds| more, polling
+// between them, and counts the heap allocations of |work| in the latter.
+class SteadyStateRounds {
+ public:
+  typedef void (*Work)(EventLoop* loop, int fd, int* counter);
+
+  SteadyStateRounds(EventLoop* loop, Work work, int warm_up, int rounds)
+      : loop_(loop),
+        work_(work),
+        warm_up_(warm_up),
+        rounds_(rounds),
+        allocations_(0),
+        counter_(0) {
+    fds_[0] = fds_[1] = -1;
+  }
+
+  ~SteadyStateRounds() {
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  // Returns the allocations counted, after running the loop.
+  size_t Run() {
+    EXPECT_EQ(0, pipe(fds_));
+    loop_->Post([this] { Next(); });
+    loop_->Run();
+    EXPECT_EQ(0, rounds_);
+    EXPECT_EQ(0, counter_);
+    return allocations_;
+  }
+
+ private:
+  void Next() {
+    if (!rounds_) {
+      loop_->QuitSoon();
+      return;
+    }
+    size_t allocations = ThreadHeapAllocations();
+    work_(loop_, fds_[0], &counter_);
+    if (warm_up_) {
+      warm_up_--;
+    } else {
+      allocations_ += ThreadHeapAllocations() - allocations;
+      rounds_--;
+    }
+    // The pipe is always writable; waiting for it makes the loop poll.
+    loop_->PostWhenWriteReady(fds_[1],
+                              [this](bool nval, bool hup, bool err) {
+                                Next();
+                              });
+  }
+
+  EventLoop* loop_;
+  Work work_;
+  int fds_[2];
+  int warm_up_;
+  int rounds_;
+  size_t allocations_;
+  int counter_;
+};
+
+void post_and_cancel_timer(EventLoop* loop, int fd, int* counter) {
+  EventLoop::TimerHandle handle =
+      loop->PostAfter([counter] { (*counter)++; }, TimeDelta(10));
+  handle.Cancel();
+}
+
+void wait_and_cancel_descriptor(EventLoop* loop, int fd, int* counter) {
+  loop->PostWhenReadReady(fd, [counter](bool nval, bool hup, bool err) {
+    (*counter)++;
+  });
+  loop->PostWhenWriteReady(fd, [counter](bool nval, bool hup, bool err) {
+    (*counter)++;
+  });
+  loop->CancelDescriptor(fd);
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, TimersDontAllocate) {
+  SteadyStateRounds rounds(loop_.get(), post_and_cancel_timer, 10, 100);
+  EXPECT_EQ(0u, rounds.Run());
+}
+
+TEST_P(EventLoopTest, DescriptorWaitsDontAllocate) {
+  SteadyStateRounds rounds(loop_.get(), wait_and_cancel_descriptor, 10,
+                           100);
+  EXPECT_EQ(0u, rounds.Run());
+}
+
+namespace {
+
+// Reads a byte from |fd| on each call, and stops |handle| after |stop_after|
+// calls.
+void read_byte(int fd, int* count, EventLoop::WatchHandle* handle,
+               int stop_after, bool nval, bool hup, bool err) {
+  uint8 byte;
+  ASSERT_EQ(1, read(fd, &byte, 1));
+  if (++(*count) == stop_after) {
+    handle->Stop();
+    EventLoop::Current()->QuitSoon();
+  }
+}
+
+void stop_both(int* count, EventLoop::WatchHandle* a, EventLoop::WatchHandle* b,
+               bool nval, bool hup, bool err) {
+  (*count)++;
+  a->Stop();
+  b->Stop();
+}
+
+void count_nval(int* count, bool nval, bool hup, bool err) {
+  EXPECT_TRUE(nval);
+  (*count)++;
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, Watch) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  int quit[2];
+  ASSERT_EQ(0, pipe(quit));
+  int count = 0;
+
+  // The watcher is invoked once per byte without registering again.
+  EventLoop::WatchHandle handle;
+  handle = loop_->WatchReadable(fds[0],
+                                Bind(read_byte, fds[0], &count, &handle, 3));
+  uint8 bytes[4] = { 0 };
+  ASSERT_EQ(3, write(fds[1], bytes, 3));
+  loop_->Run();
+  EXPECT_EQ(3, count);
+  EXPECT_EQ(1u, loop_->allocation_stats().poll_tasks.allocations);
+
+  // It was stopped.
+  ASSERT_EQ(1, write(fds[1], bytes, 1));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ(3, count);
+  EventLoop::AllocationStats stats = loop_->allocation_stats();
+  EXPECT_EQ(stats.poll_tasks.allocations, stats.poll_tasks.frees);
+
+  // The descriptor can be watched again.
+  handle = loop_->WatchReadable(fds[0],
+                                Bind(read_byte, fds[0], &count, &handle, 4));
+  loop_->Run();
+  EXPECT_EQ(4, count);
+
+  close(fds[0]);
+  close(fds[1]);
+  close(quit[0]);
+  close(quit[1]);
+}
+
+TEST_P(EventLoopTest, PendingTasks) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  int counter = 0;
+  int count = 0;
+  Time start;
+  now_ = start;
+
+  std::vector<EventLoop::Callback> tasks;
+  tasks.push_back(Bind(increment, &counter));
+  tasks.push_back(Bind(increment, &counter));
+  loop_->Post(Bind(increment, &counter));
+  loop_->PostBatch(std::move(tasks));
+  loop_->PostAfter(Bind(increment, &counter), TimeDelta(10));
+  EventLoop::WatchHandle handle;
+  handle = loop_->WatchReadable(fds[0],
+                                Bind(read_byte, fds[0], &count, &handle, 1));
+  EXPECT_EQ(3u, loop_->pending_tasks());
+
+  // Neither the watcher nor the delayed task count while they wait.
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(3, counter);
+  EXPECT_EQ(0u, loop_->pending_tasks());
+
+  now_ = start + TimeDelta(10);
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(4, counter);
+  EXPECT_EQ(0u, loop_->pending_tasks());
+
+  handle.Stop();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_P(EventLoopTest, StopWatch) {
+  int a[2];
+  int b[2];
+  int quit[2];
+  ASSERT_EQ(0, pipe(a));
+  ASSERT_EQ(0, pipe(b));
+  ASSERT_EQ(0, pipe(quit));
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(a[1], &byte, 1));
+  ASSERT_EQ(1, write(b[1], &byte, 1));
+
+  // Both are ready at once, but the first one to run stops the other.
+  int count = 0;
+  EventLoop::WatchHandle handle_a;
+  EventLoop::WatchHandle handle_b;
+  handle_a = loop_->WatchReadable(
+      a[0], Bind(stop_both, &count, &handle_a, &handle_b));
+  handle_b = loop_->WatchReadable(
+      b[0], Bind(stop_both, &count, &handle_a, &handle_b));
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ(1, count);
+
+  // Stopped from another thread before the loop runs.
+  EventLoop::WatchHandle handle = loop_->WatchReadable(
+      a[0], Bind(stop_both, &count, &handle_a, &handle_b));
+  std::thread other(Bind(&EventLoop::WatchHandle::Stop, &handle));
+  other.join();
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ(1, count);
+
+  // CancelDescriptor() stops watchers too.
+  handle = loop_->WatchReadable(
+      a[0], Bind(stop_both, &count, &handle_a, &handle_b));
+  loop_->CancelDescriptor(a[0]);
+  loop_->PostWhenWriteReady(quit[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ(1, count);
+  // Stopping it afterwards, from off the loop, is harmless.
+  handle.Stop();
+  loop_->QuitSoon();
+  loop_->Run();
+  EventLoop::AllocationStats stats = loop_->allocation_stats();
+  EXPECT_EQ(stats.poll_tasks.allocations, stats.poll_tasks.frees);
+
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+  close(quit[0]);
+  close(quit[1]);
+}
+
+TEST_P(EventLoopTest, WatchInvalidDescriptor) {
+  int quit[2];
+  ASSERT_EQ(0, pipe(quit));
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[0]);
+  close(fds[1]);
+
+  // The watcher is stopped after it sees |nval|.
+  int count = 0;
+  loop_->WatchReadable(fds[0], Bind(count_nval, &count));
+  for (int i = 0; i < 3; ++i) {
+    loop_->PostWhenWriteReady(
+        quit[1], Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+    loop_->Run();
+  }
+  EXPECT_EQ(1, count);
+
+  close(quit[0]);
+  close(quit[1]);
+}
+
+TEST_P(EventLoopTest, FullDuplex) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  std::vector<int> read_ready;
+  std::vector<int> write_ready;
+
+  // Waiting to read doesn't prevent waiting to write, and the other way
+  // around.
+  loop_->PostWhenReadReady(fds[0], Bind(record_fd, &read_ready, fds[0]));
+  loop_->PostWhenWriteReady(fds[0], Bind(record_fd, &write_ready, fds[0]));
+  loop_->PostWhenWriteReady(fds[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_TRUE(read_ready.empty());
+  ASSERT_EQ(1u, write_ready.size());
+
+  // Still waiting to read.
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+  loop_->PostWhenWriteReady(fds[0], Bind(record_fd, &write_ready, fds[0]));
+  loop_->PostWhenWriteReady(fds[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  ASSERT_EQ(1u, read_ready.size());
+  EXPECT_EQ(2u, write_ready.size());
+
+  // Both directions can be watched at once, and stopped separately.
+  int count = 0;
+  EventLoop::WatchHandle reader;
+  reader = loop_->WatchReadable(fds[0],
+                                Bind(read_byte, fds[0], &count, &reader, 1));
+  EventLoop::WatchHandle writer = loop_->WatchWritable(
+      fds[0], Bind(record_fd, &write_ready, fds[0]));
+  loop_->Run();
+  EXPECT_EQ(1, count);
+  EXPECT_LE(3u, write_ready.size());
+  writer.Stop();
+
+  // Cancelling the descriptor cancels both directions.
+  loop_->PostWhenReadReady(fds[0], Bind(record_fd, &read_ready, fds[0]));
+  loop_->PostWhenWriteReady(fds[0], Bind(record_fd, &write_ready, fds[0]));
+  loop_->CancelDescriptor(fds[0]);
+  loop_->PostWhenWriteReady(fds[1],
+                            Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+  size_t writes = write_ready.size();
+  loop_->Run();
+  EXPECT_EQ(1u, read_ready.size());
+  EXPECT_EQ(writes, write_ready.size());
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+namespace {
+
+void record_result(EventLoop* loop, std::vector<int>* results,
+                   size_t expected, int result) {
+  results->push_back(result);
+  if (results->size() == expected)
+    loop->QuitSoon();
+}
+
+void start_read_write(EventLoop* loop, const int* fds, char* in,
+                      const char* out, std::vector<int>* results) {
+  loop->PostRead(fds[0], in, 16, Bind(record_result, loop, results, 2));
+  loop->PostWrite(fds[1], out, 5, Bind(record_result, loop, results, 2));
+}
+
+void start_accept(EventLoop* loop, int fd, std::vector<int>* results) {
+  loop->PostAccept(fd, Bind(record_result, loop, results, 1));
+}
+
+void start_read_and_cancel(EventLoop* loop, int fd, char* in,
+                           std::vector<int>* results) {
+  loop->PostRead(fd, in, 16, Bind(record_result, loop, results, 1));
+  loop->CancelDescriptor(fd);
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, ReadWriteOperations) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  char in[16] = { 0 };
+  std::vector<int> results;
+
+  // The read waits for the write, even on a non-blocking descriptor.
+  loop_->Post(Bind(start_read_write, loop_.get(), fds, in, "hello", &results));
+  loop_->Run();
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ(5, results[0]);
+  EXPECT_EQ(5, results[1]);
+  EXPECT_EQ("hello", std::string(in));
+
+  // End of file.
+  close(fds[1]);
+  results.clear();
+  loop_->Post(Bind(start_read_and_cancel, loop_.get(), fds[0], in, &results));
+  loop_->Run();
+  ASSERT_EQ(1u, results.size());
+  EXPECT_TRUE(results[0] == 0 || results[0] == -ECANCELED);
+  EXPECT_EQ(0u, loop_->allocation_stats().io_tasks.allocations -
+                loop_->allocation_stats().io_tasks.frees);
+  close(fds[0]);
+}
+
+TEST_P(EventLoopTest, CancelOperation) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  char in[16];
+  std::vector<int> results;
+
+  // Cancelled operations still complete.
+  loop_->Post(Bind(start_read_and_cancel, loop_.get(), fds[0], in, &results));
+  loop_->Run();
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ(-ECANCELED, results[0]);
+
+  // Invalid descriptors fail.
+  int fd = dup(fds[0]);
+  close(fd);
+  results.clear();
+  loop_->Post(Bind(start_accept, loop_.get(), fd, &results));
+  loop_->Run();
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ(-EBADF, results[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_P(EventLoopTest, AcceptOperation) {
+  int server = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  ASSERT_NE(-1, server);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t size = sizeof(addr);
+  ASSERT_EQ(0, bind(server, (sockaddr*) &addr, size));
+  ASSERT_EQ(0, listen(server, 1));
+  ASSERT_EQ(0, getsockname(server, (sockaddr*) &addr, &size));
+
+  std::vector<int> results;
+  loop_->Post(Bind(start_accept, loop_.get(), server, &results));
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_EQ(0, connect(client, (sockaddr*) &addr, size));
+  loop_->Run();
+  ASSERT_EQ(1u, results.size());
+  ASSERT_LE(0, results[0]);
+  unique_ptr<Socket> connection = Socket::AdoptConnection(results[0]);
+  EXPECT_TRUE(fcntl(connection->fd(), F_GETFL) & O_NONBLOCK);
+  EXPECT_TRUE(fcntl(connection->fd(), F_GETFD) & FD_CLOEXEC);
+  close(client);
+  close(server);
+}
+
+namespace {
+
+void record_name(std::string* order, char name) {
+  order->push_back(name);
+}
+
+void post_high(EventLoop* loop, std::string* order, char name) {
+  order->push_back('b');
+  loop->Post(Bind(record_name, order, name), EventLoop::HIGH);
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, Priorities) {
+  std::string order;
+  loop_->Post(Bind(record_name, &order, 'b'), EventLoop::BACKGROUND);
+  loop_->Post(Bind(record_name, &order, 'n'));
+  loop_->Post(Bind(record_name, &order, 'h'), EventLoop::HIGH);
+  loop_->Post(Bind(record_name, &order, 'n'), EventLoop::NORMAL);
+  loop_->PostAfter(Bind(record_name, &order, 'H'), TimeDelta(),
+                   EventLoop::HIGH);
+  loop_->QuitSoon();
+  loop_->Run();
+  // The delayed task is only queued after the tasks that were ready.
+  EXPECT_EQ("hnnbH", order);
+
+  // Tasks posted while running go before the lower priorities.
+  order.clear();
+  loop_->Post(Bind(post_high, loop_.get(), &order, 'x'),
+              EventLoop::BACKGROUND);
+  loop_->Post(Bind(record_name, &order, 'b'), EventLoop::BACKGROUND);
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ("bxb", order);
+}
+
+TEST_P(EventLoopTest, StarvationRatio) {
+  std::string order;
+  loop_->SetStarvationRatio(2);
+  for (int i = 0; i < 6; ++i)
+    loop_->Post(Bind(record_name, &order, 'h'), EventLoop::HIGH);
+  for (int i = 0; i < 2; ++i)
+    loop_->Post(Bind(record_name, &order, 'b'), EventLoop::BACKGROUND);
+  loop_->Post(Bind(record_name, &order, 'n'));
+  loop_->QuitSoon();
+  loop_->Run();
+  // Both lower priorities waited for two tasks; the lowest goes first.
+  EXPECT_EQ("hhbnhbhhh", order);
+}
+
+namespace {
+
+// Keeps posting itself until |stop| is set, advancing |now| by |step|.
+void repost(EventLoop* loop, bool* stop, int* count, Time* now,
+            TimeDelta step) {
+  (*count)++;
+  *now += step;
+  if (!*stop)
+    loop->Post(Bind(repost, loop, stop, count, now, step));
+}
+
+void stop_and_quit(EventLoop* loop, bool* stop, bool nval, bool hup,
+                   bool err) {
+  *stop = true;
+  loop->QuitSoon();
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, FairnessBudget) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+
+  // The descriptor is looked at after 10 tasks, and the one posted by the
+  // last of them still runs.
+  bool stop = false;
+  int count = 0;
+  loop_->SetFairnessBudget(10);
+  loop_->PostWhenReadReady(fds[0], Bind(stop_and_quit, loop_.get(), &stop));
+  loop_->Post(Bind(repost, loop_.get(), &stop, &count, &now_, TimeDelta()));
+  loop_->Run();
+  EXPECT_EQ(11, count);
+
+  // The same, after 5ms.
+  stop = false;
+  count = 0;
+  loop_->SetFairnessBudget(0, TimeDelta(5));
+  loop_->PostWhenReadReady(fds[0], Bind(stop_and_quit, loop_.get(), &stop));
+  loop_->Post(Bind(repost, loop_.get(), &stop, &count, &now_, TimeDelta(1)));
+  loop_->Run();
+  EXPECT_EQ(6, count);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_P(EventLoopTest, RuntimeStats) {
+  loop_->SetTaskSampling(1);
+  EventLoop::RuntimeStats before = loop_->runtime_stats();
+  EXPECT_EQ(0u, before.task_run_time.count);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds[1], &byte, 1));
+  int counter = 0;
+  for (int i = 0; i < 3; ++i)
+    loop_->Post(Bind(increment, &counter));
+  loop_->PostWhenReadReady(fds[0],
+                           Bind(&EventLoopTest::QuitSoon, this, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ(3, counter);
+
+  EventLoop::RuntimeStats after = loop_->runtime_stats();
+  EXPECT_LT(before.time, after.time);
+  EXPECT_EQ(1u, after.queue_depth.count);
+  EXPECT_EQ(3u, after.queue_depth.max);
+  EXPECT_EQ(3u, after.task_latency.count);
+  EXPECT_EQ(3u, after.task_run_time.count);
+  EXPECT_LE(1u, after.poll_time.count);
+  EXPECT_EQ(after.poll_time.count, after.ready_fds.count);
+  EXPECT_EQ(1u, after.ready_fds.max);
+  EXPECT_LT(0, after.WakeupsPerSecond(before));
+
+  // Only a sample of the tasks is timed.
+  for (uint32 interval: { 2, 0 }) {
+    loop_->SetTaskSampling(interval);
+    before = loop_->runtime_stats();
+    for (int i = 0; i < 4; ++i)
+      loop_->Post(Bind(increment, &counter));
+    loop_->QuitSoon();
+    loop_->Run();
+    after = loop_->runtime_stats();
+    EXPECT_EQ(interval ? 2u : 0u,
+              after.task_latency.count - before.task_latency.count);
+    EXPECT_EQ(interval ? 2u : 0u,
+              after.task_run_time.count - before.task_run_time.count);
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+namespace {
+
+void append_char(std::string* order, char c) {
+  order->push_back(c);
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, PostBatch) {
+  std::string order;
+  std::vector<EventLoop::Callback> tasks;
+  for (char c = 'a'; c < 'e'; ++c)
+    tasks.push_back(Bind(append_char, &order, c));
+  loop_->Post(Bind(append_char, &order, '0'));
+  loop_->PostBatch(std::move(tasks));
+  loop_->Post(Bind(append_char, &order, '1'));
+  loop_->PostBatch(std::vector<EventLoop::Callback>());
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ("0abcd1", order);
+}
+
+TEST_P(EventLoopTest, Batch) {
+  std::string order;
+  {
+    EventLoop::Batch batch(loop_.get(), 3, TimeDelta(10));
+    batch.Post(Bind(append_char, &order, 'a'));
+    batch.Post(Bind(append_char, &order, 'b'));
+    EXPECT_EQ(2u, batch.size());
+    // Full.
+    batch.Post(Bind(append_char, &order, 'c'));
+    EXPECT_EQ(0u, batch.size());
+
+    // Too old.
+    batch.Post(Bind(append_char, &order, 'd'));
+    now_ += TimeDelta(10);
+    batch.Post(Bind(append_char, &order, 'e'));
+    EXPECT_EQ(0u, batch.size());
+
+    batch.Post(Bind(append_char, &order, 'f'));
+    batch.Flush();
+    EXPECT_EQ(0u, batch.size());
+    loop_->Post(Bind(append_char, &order, '-'));
+
+    // Flushed when deleted.
+    batch.Post(Bind(append_char, &order, 'g'));
+    EXPECT_EQ(1u, batch.size());
+  }
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ("abcdef-g", order);
+}
+
+TEST_P(EventLoopTest, BatchFlushTimer) {
+  std::string order;
+  EventLoop::Batch batch(loop_.get(), 3, TimeDelta(10));
+  EventLoop* loop = loop_.get();
+  // A producer on a loop that goes quiet is flushed by a timer on that loop.
+  loop_->Post([&batch, &order, loop] {
+    batch.Post(Bind(append_char, &order, 'a'));
+    loop->QuitSoon();
+  });
+  loop_->Run();
+  EXPECT_EQ(1u, batch.size());
+
+  now_ += TimeDelta(9);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop));
+  loop_->Run();
+  EXPECT_EQ(1u, batch.size());
+
+  now_ += TimeDelta(1);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop));
+  loop_->Run();
+  EXPECT_EQ(0u, batch.size());
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop));
+  loop_->Run();
+  EXPECT_EQ("a", order);
+}
+
+TEST_P(EventLoopTest, PreciseAfter) {
+  Time start;
+  now_ = start;
+  std::string order;
+
+  loop_->PostAfter(Bind(record_name, &order, 'c'), PreciseTimeDelta(1000));
+  loop_->PostAfter(Bind(record_name, &order, 'b'), PreciseTimeDelta(300));
+  loop_->PostAfter(Bind(record_name, &order, 'a'), PreciseTimeDelta(150));
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ("", order);
+
+  // Tasks due within the same millisecond don't run together.
+  now_ = start + PreciseTimeDelta(149);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ("", order);
+
+  now_ = start + PreciseTimeDelta(150);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ("a", order);
+
+  now_ = start + PreciseTimeDelta(999);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ("ab", order);
+
+  now_ = start + TimeDelta(1);
+  loop_->Post(Bind(&EventLoop::QuitSoon, loop_.get()));
+  loop_->Run();
+  EXPECT_EQ("abc", order);
+}
+
+TEST_P(EventLoopTest, BusyPoll) {
+  // Tasks posted right after the previous one ran are found while spinning.
+  loop_->SetBusyPoll(TimeDelta(100));
+  EXPECT_EQ(100000000u, loop_->runtime_stats().spin_window);
+  std::thread runner(Bind(&EventLoop::Run, loop_.get()));
+  std::atomic<int> counter(0);
+  for (int i = 1; i <= 10; ++i) {
+    loop_->Post(Bind(increment_atomic, &counter));
+    while (counter != i)
+      std::this_thread::yield();
+  }
+  loop_->QuitSoon();
+  runner.join();
+  EventLoop::RuntimeStats stats = loop_->runtime_stats();
+  EXPECT_LE(1u, stats.spin_hits);
+  EXPECT_LE(stats.spin_hits, stats.spin_time.count);
+  EXPECT_LT(0u, stats.spin_window);
+
+  // The window closes when tasks come in slower than the maximum spin.
+  unique_ptr<EventLoop> loop = EventLoop::Create(GetParam());
+  loop->SetBusyPoll(PreciseTimeDelta(200));
+  std::thread slow_runner(Bind(&EventLoop::Run, loop.get()));
+  for (int i = 11; i <= 30; ++i) {
+    std::this_thread::sleep_for(TimeDelta(2));
+    loop->Post(Bind(increment_atomic, &counter));
+  }
+  while (counter != 30)
+    std::this_thread::yield();
+  EXPECT_EQ(0u, loop->runtime_stats().spin_window);
+  loop->QuitSoon();
+  slow_runner.join();
+}
+
+TEST_P(EventLoopTest, PostFromLoop) {
+  // Tasks posted by the loop's own thread go after the ones other threads
+  // posted before them.
+  std::string order;
+  loop_->Post(Bind(record_name, &order, 'a'));
+  loop_->Post([this, &order] {
+    std::thread other([this, &order] {
+      loop_->Post(Bind(record_name, &order, 'c'));
+    });
+    other.join();
+    loop_->Post(Bind(record_name, &order, 'd'));
+    std::vector<EventLoop::Callback> tasks;
+    tasks.push_back(Bind(record_name, &order, 'e'));
+    tasks.push_back(Bind(record_name, &order, 'f'));
+    loop_->PostBatch(std::move(tasks));
+    record_name(&order, 'b');
+  });
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ("abcdef", order);
+}
+
+namespace {
+
+void take_value(unique_ptr<int> value, int* result) {
+  *result += *value;
+}
+
+}  // namespace
+
+TEST_P(EventLoopTest, PostOnce) {
+  // Move-only state goes along with the task.
+  int result = 0;
+  loop_->Post(BindOnce(take_value, make_unique(new int(7)), &result));
+  unique_ptr<int> value(new int(8));
+  loop_->Post([&result] { result++; });
+  loop_->PostAfter(BindOnce(take_value, std::move(value), &result),
+                   TimeDelta(0));
+  loop_->QuitSoon();
+  loop_->Run();
+  EXPECT_EQ(16, result);
+}
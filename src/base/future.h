@@ -0,0 +1,537 @@
+#ifndef BASE_FUTURE_H
+#define BASE_FUTURE_H
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/base.h"
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+
+// A Future<T> is a value of type T that becomes available later, usually on
+// another thread, and a Promise<T> is what provides it:
+//
+//   Promise<int> promise;
+//   Future<int> future = promise.future();
+//   future.Then(loop, Bind(Print));
+//   ...
+//   promise.SetValue(42);  // Posts Print(42) to |loop|.
+//
+// Then() returns the Future of what its continuation returns, so stages can
+// be chained, each one running on its own EventLoop. A continuation that
+// returns a Future<U> is flattened into a Future<U>. T can be void, in which
+// case the continuation takes no arguments, and can be move-only.
+//
+// Each stage makes a single allocation, that holds the value, the
+// continuation and a reference count; handing the value to the next stage
+// posts one task to its loop. There is no error channel: if a Promise is
+// deleted without a value, the stages that depend on it never run, and are
+// released on the thread that deleted it.
+//
+// Futures and Promises can be moved across threads, but each one should only
+// be used by one thread at a time.
+
+template<typename T>
+class Future;
+
+template<typename T>
+class Promise;
+
+namespace internal {
+
+// The value of a Future<void>.
+struct Void {};
+
+template<typename T>
+struct FutureValue {
+  typedef T Type;
+};
+
+template<>
+struct FutureValue<void> {
+  typedef Void Type;
+};
+
+// Receives the value of a FutureState, or learns that it won't get one.
+template<typename T>
+class Continuation {
+ public:
+  virtual void OnValue(T&& value) = 0;
+  virtual void OnAbandon() = 0;
+
+ protected:
+  ~Continuation() {}
+};
+
+// The state shared by a producer, which sets the value or abandons it, and a
+// consumer, which sets the Continuation or drops the Future. Each holds a
+// reference, and gives it up once done.
+template<typename T>
+class FutureState {
+ public:
+  FutureState()
+      : refs_(2),
+        flags_(0),
+        next_(NULL),
+        loop_(NULL),
+        priority_(EventLoop::NORMAL) {}
+
+  virtual ~FutureState() {
+    if (flags_.load(std::memory_order_relaxed) & kValue)
+      value()->~T();
+  }
+
+  void AddRef() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
+  }
+
+  // These give up the producer's reference.
+  void SetValue(T&& value) {
+    new (&storage_) T(std::move(value));
+    if (flags_.fetch_or(kValue, std::memory_order_acq_rel) & kContinuation)
+      Dispatch();
+    Release();
+  }
+
+  void Abandon() {
+    if (flags_.fetch_or(kAbandoned, std::memory_order_acq_rel) &
+        kContinuation) {
+      next_->OnAbandon();
+      Release();
+    }
+    Release();
+  }
+
+  // Gives up the consumer's reference once |next| has been invoked. |next|
+  // runs on |loop|, or right away on the thread that provides the value when
+  // |loop| is NULL.
+  void SetContinuation(Continuation<T>* next, EventLoop* loop,
+                       EventLoop::Priority priority) {
+    next_ = next;
+    loop_ = loop;
+    priority_ = priority;
+    int flags = flags_.fetch_or(kContinuation, std::memory_order_acq_rel);
+    if (flags & kValue) {
+      Dispatch();
+    } else if (flags & kAbandoned) {
+      next->OnAbandon();
+      Release();
+    }
+  }
+
+ private:
+  enum {
+    kValue = 1 << 0,
+    kAbandoned = 1 << 1,
+    kContinuation = 1 << 2,
+  };
+
+  T* value() { return reinterpret_cast<T*>(&storage_); }
+
+  void Dispatch() {
+    // The lambda is kept inline in the task, so the hop doesn't allocate.
+    FutureState* self = this;
+    if (loop_)
+      loop_->Post([self] { self->RunContinuation(); }, priority_);
+    else
+      RunContinuation();
+  }
+
+  void RunContinuation() {
+    next_->OnValue(std::move(*value()));
+    Release();
+  }
+
+  std::atomic<int> refs_;
+  std::atomic<int> flags_;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+  Continuation<T>* next_;
+  EventLoop* loop_;
+  EventLoop::Priority priority_;
+
+  DISALLOW_COPY_AND_ASSIGN(FutureState);
+};
+
+// Lets the helpers below get at the state of Futures.
+struct FutureAccess {
+  template<typename T>
+  static FutureState<typename FutureValue<T>::Type>* Take(Future<T>* future) {
+    DCHECK(future->state_);
+    auto state = future->state_;
+    future->state_ = NULL;
+    return state;
+  }
+
+  template<typename T>
+  static Future<T> Make(FutureState<typename FutureValue<T>::Type>* state) {
+    return Future<T>(state);
+  }
+};
+
+// Invokes |f| with |value|, or without arguments for a Future<void>.
+template<typename F, typename T>
+auto Invoke(F& f, T& value) -> decltype(f(std::move(value))) {
+  return f(std::move(value));
+}
+
+template<typename F>
+auto Invoke(F& f, Void& value) -> decltype(f()) {
+  return f();
+}
+
+// What a Then() continuation returns, and the Future that Then() returns.
+template<typename R>
+struct ThenResult {
+  typedef R Type;
+};
+
+template<typename U>
+struct ThenResult<Future<U>> {
+  typedef U Type;
+};
+
+// A stage: the continuation of a FutureState<In>, that produces its own
+// value by invoking |f|. It is also the producer of its own FutureState, and
+// only gives up that reference once it has a value to set.
+template<typename In, typename F, typename R>
+class ThenState
+    : public FutureState<typename FutureValue<
+          typename ThenResult<R>::Type>::Type>,
+      public Continuation<In> {
+ public:
+  typedef typename FutureValue<typename ThenResult<R>::Type>::Type Out;
+
+  template<typename G>
+  explicit ThenState(G&& f) : f_(std::forward<G>(f)) {}
+
+  virtual void OnValue(In&& value) override {
+    Produce(value, static_cast<R*>(NULL));
+  }
+
+  virtual void OnAbandon() override {
+    this->Abandon();
+  }
+
+ private:
+  // Forwards the value of the Future returned by |f_| to this stage.
+  class Forwarder : public Continuation<Out> {
+   public:
+    explicit Forwarder(ThenState* state) : state_(state) {}
+
+    virtual void OnValue(Out&& value) override {
+      state_->SetValue(std::move(value));
+    }
+
+    virtual void OnAbandon() override {
+      state_->Abandon();
+    }
+
+   private:
+    ThenState* state_;
+  };
+
+  template<typename Any>
+  void Produce(In& value, Any*) {
+    this->SetValue(Invoke(f_, value));
+  }
+
+  void Produce(In& value, void*) {
+    Invoke(f_, value);
+    this->SetValue(Void());
+  }
+
+  template<typename U>
+  void Produce(In& value, Future<U>*) {
+    Future<U> future = Invoke(f_, value);
+    FutureAccess::Take(&future)->SetContinuation(
+        new (&forwarder_) Forwarder(this), NULL, EventLoop::NORMAL);
+  }
+
+  F f_;
+  typename std::aligned_storage<sizeof(Forwarder),
+                                alignof(Forwarder)>::type forwarder_;
+};
+
+// The stage for a continuation |F| of a FutureState<In>.
+template<typename In, typename F>
+struct ThenStateFor {
+  typedef typename std::decay<F>::type Functor;
+  typedef decltype(Invoke(std::declval<Functor&>(), std::declval<In&>())) R;
+  typedef ThenState<In, Functor, R> Type;
+  typedef typename ThenResult<R>::Type Value;
+};
+
+// The state of WhenAll(): one Slot per input, and the values collected so far.
+template<typename T>
+class WhenAllState : public FutureState<std::vector<T>> {
+ public:
+  explicit WhenAllState(std::vector<Future<T>>&& futures)
+      : values_(futures.size()),
+        remaining_(futures.size()),
+        abandoned_(false) {
+    slots_.reserve(futures.size());
+    for (size_t i = 0; i < futures.size(); ++i)
+      slots_.push_back(Slot(this, i));
+    if (futures.empty()) {
+      this->SetValue(std::move(values_));
+      return;
+    }
+    for (size_t i = 0; i < futures.size(); ++i) {
+      FutureAccess::Take(&futures[i])->SetContinuation(
+          &slots_[i], NULL, EventLoop::NORMAL);
+    }
+  }
+
+ private:
+  class Slot : public Continuation<T> {
+   public:
+    Slot(WhenAllState* state, size_t index) : state_(state), index_(index) {}
+
+    virtual void OnValue(T&& value) override {
+      state_->values_[index_] = std::move(value);
+      state_->Arrive();
+    }
+
+    virtual void OnAbandon() override {
+      state_->abandoned_ = true;
+      state_->Arrive();
+    }
+
+   private:
+    WhenAllState* state_;
+    size_t index_;
+  };
+
+  void Arrive() {
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    if (abandoned_)
+      this->Abandon();
+    else
+      this->SetValue(std::move(values_));
+  }
+
+  std::vector<T> values_;
+  std::vector<Slot> slots_;
+  std::atomic<size_t> remaining_;
+  std::atomic<bool> abandoned_;
+};
+
+// The state of WhenAny(). The slots hold a reference of their own, since they
+// keep arriving after the first value has been set.
+template<typename T>
+class WhenAnyState : public FutureState<std::pair<size_t, T>> {
+ public:
+  explicit WhenAnyState(std::vector<Future<T>>&& futures)
+      : remaining_(futures.size()),
+        done_(false) {
+    DCHECK(!futures.empty());
+    this->AddRef();
+    slots_.reserve(futures.size());
+    for (size_t i = 0; i < futures.size(); ++i)
+      slots_.push_back(Slot(this, i));
+    for (size_t i = 0; i < futures.size(); ++i) {
+      FutureAccess::Take(&futures[i])->SetContinuation(
+          &slots_[i], NULL, EventLoop::NORMAL);
+    }
+  }
+
+ private:
+  class Slot : public Continuation<T> {
+   public:
+    Slot(WhenAnyState* state, size_t index) : state_(state), index_(index) {}
+
+    virtual void OnValue(T&& value) override {
+      WhenAnyState* state = state_;
+      if (!state->done_.exchange(true))
+        state->SetValue(std::make_pair(index_, std::move(value)));
+      state->Arrive();
+    }
+
+    virtual void OnAbandon() override {
+      state_->Arrive();
+    }
+
+   private:
+    WhenAnyState* state_;
+    size_t index_;
+  };
+
+  void Arrive() {
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    if (!done_)
+      this->Abandon();
+    this->Release();
+  }
+
+  std::vector<Slot> slots_;
+  std::atomic<size_t> remaining_;
+  std::atomic<bool> done_;
+};
+
+}  // namespace internal
+
+template<typename T>
+class Future {
+ public:
+  typedef typename internal::FutureValue<T>::Type Value;
+
+  // An invalid Future, that can be assigned to.
+  Future() : state_(NULL) {}
+
+  Future(Future&& other) : state_(other.state_) {
+    other.state_ = NULL;
+  }
+
+  ~Future() {
+    if (state_)
+      state_->Release();
+  }
+
+  Future& operator=(Future&& other) {
+    std::swap(state_, other.state_);
+    return *this;
+  }
+
+  // Returns false for a default constructed Future, and once Then() has been
+  // invoked.
+  bool valid() const { return state_ != NULL; }
+
+  // Posts |f| to |loop| once the value is available, with the value as its
+  // argument, and returns the Future of what |f| returns. This Future becomes
+  // invalid. Can be invoked from any thread.
+  template<typename F>
+  Future<typename internal::ThenStateFor<Value, F>::Value> Then(
+      EventLoop* loop, F&& f,
+      EventLoop::Priority priority = EventLoop::NORMAL) {
+    DCHECK(loop);
+    typedef internal::ThenStateFor<Value, F> For;
+    typename For::Type* state = new typename For::Type(std::forward<F>(f));
+    internal::FutureAccess::Take(this)->SetContinuation(state, loop, priority);
+    return internal::FutureAccess::Make<typename For::Value>(state);
+  }
+
+ private:
+  friend struct internal::FutureAccess;
+  friend class Promise<T>;
+
+  explicit Future(internal::FutureState<Value>* state) : state_(state) {}
+
+  internal::FutureState<Value>* state_;
+
+  DISALLOW_COPY_AND_ASSIGN(Future);
+};
+
+template<typename T>
+class Promise {
+ public:
+  typedef typename internal::FutureValue<T>::Type Value;
+
+  Promise()
+      : state_(new internal::FutureState<Value>),
+        has_future_(false) {}
+
+  Promise(Promise&& other)
+      : state_(other.state_),
+        has_future_(other.has_future_) {
+    other.state_ = NULL;
+  }
+
+  // Abandons the Future, if there's no value yet.
+  ~Promise() {
+    if (!state_)
+      return;
+    if (!has_future_)
+      state_->Release();
+    state_->Abandon();
+  }
+
+  Promise& operator=(Promise&& other) {
+    std::swap(state_, other.state_);
+    std::swap(has_future_, other.has_future_);
+    return *this;
+  }
+
+  // Returns the Future of this Promise. Can only be invoked once, before the
+  // value is set.
+  Future<T> future() {
+    DCHECK(state_);
+    DCHECK(!has_future_);
+    has_future_ = true;
+    return Future<T>(state_);
+  }
+
+  // Sets the value, and posts the continuation of the Future if it has one.
+  // Can only be invoked once.
+  void SetValue(Value value) {
+    DCHECK(state_);
+    if (!has_future_)
+      state_->Release();
+    state_->SetValue(std::move(value));
+    state_ = NULL;
+  }
+
+  // For a Promise<void>.
+  void SetValue() {
+    static_assert(std::is_void<T>::value, "SetValue() needs a value");
+    SetValue(Value());
+  }
+
+ private:
+  internal::FutureState<Value>* state_;
+  bool has_future_;
+
+  DISALLOW_COPY_AND_ASSIGN(Promise);
+};
+
+// Returns a Future that already has |value|.
+template<typename T>
+Future<typename std::decay<T>::type> MakeReadyFuture(T&& value) {
+  Promise<typename std::decay<T>::type> promise;
+  Future<typename std::decay<T>::type> future = promise.future();
+  promise.SetValue(std::forward<T>(value));
+  return future;
+}
+
+// Posts |f| to |loop|, and returns the Future of what it returns. This makes
+// a single allocation, unlike PostAndReply() which needs two tasks and can't
+// pass a value to the reply.
+template<typename F>
+Future<typename internal::ThenStateFor<internal::Void, F>::Value>
+PostWithFuture(EventLoop* loop, F&& f,
+               EventLoop::Priority priority = EventLoop::NORMAL) {
+  typedef internal::ThenStateFor<internal::Void, F> For;
+  typename For::Type* state = new typename For::Type(std::forward<F>(f));
+  loop->Post([state] { state->OnValue(internal::Void()); }, priority);
+  return internal::FutureAccess::Make<typename For::Value>(state);
+}
+
+// Returns the Future of the values of all |futures|, in the same order. If
+// any of them is abandoned, so is the result. T must be default
+// constructible, and can't be void.
+template<typename T>
+Future<std::vector<T>> WhenAll(std::vector<Future<T>>&& futures) {
+  return internal::FutureAccess::Make<std::vector<T>>(
+      new internal::WhenAllState<T>(std::move(futures)));
+}
+
+// Returns the Future of the first of |futures| to get a value, with its
+// index. It is only abandoned if all of them are. |futures| can't be empty,
+// and T can't be void.
+template<typename T>
+Future<std::pair<size_t, T>> WhenAny(std::vector<Future<T>>&& futures) {
+  return internal::FutureAccess::Make<std::pair<size_t, T>>(
+      new internal::WhenAnyState<T>(std::move(futures)));
+}
+
+#endif  // BASE_FUTURE_H
@@ -0,0 +1,211 @@
+#include "base/future.h"
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/unittest.h"
+
+namespace {
+
+int twenty_one() {
+  return 21;
+}
+
+class FutureTest : public TwoLoopTest {};
+
+}  // namespace
+
+TEST_F(FutureTest, Then) {
+  EventLoop* loop = loop_.get();
+  EventLoop* other = other_.get();
+  int result = 0;
+
+  // Hops between the loops, passing the value along.
+  PostWithFuture(other, Bind(twenty_one))
+      .Then(loop, [loop](int value) {
+        EXPECT_EQ(loop, EventLoop::Current());
+        return value * 2;
+      })
+      .Then(other, [other](int value) {
+        EXPECT_EQ(other, EventLoop::Current());
+        return std::to_string(value);
+      })
+      .Then(loop, [loop, &result](std::string value) {
+        EXPECT_EQ(loop, EventLoop::Current());
+        result = std::stoi(value);
+        loop->QuitSoon();
+      });
+  EXPECT_TRUE(Run());
+  EXPECT_EQ(42, result);
+}
+
+TEST_F(FutureTest, OneAllocationPerStage) {
+  EventLoop* loop = loop_.get();
+  // Warms up the loop, so that its tasks don't allocate below.
+  loop_->Post([] {});
+  RunAllPending();
+
+  Promise<int> promise;
+  Future<int> future = promise.future();
+  int result = 0;
+  size_t allocations = ThreadHeapAllocations();
+  future.Then(loop, [](int value) { return value + 1; })
+      .Then(loop, [loop, &result](int value) {
+        result = value;
+        loop->QuitSoon();
+      });
+  EXPECT_EQ(2u, ThreadHeapAllocations() - allocations);
+
+  // Handing the value to each stage only posts a task.
+  allocations = ThreadHeapAllocations();
+  promise.SetValue(41);
+  RunAllPending();
+  EXPECT_EQ(0u, ThreadHeapAllocations() - allocations);
+  EXPECT_EQ(42, result);
+}
+
+TEST_F(FutureTest, Promise) {
+  EventLoop* loop = loop_.get();
+  Promise<unique_ptr<int>> promise;
+  Future<unique_ptr<int>> future = promise.future();
+  EXPECT_TRUE(future.valid());
+
+  // The value is moved along, and void stages take no arguments.
+  int result = 0;
+  Future<void> done = future.Then(loop, [&result](unique_ptr<int> value) {
+    result = *value;
+  });
+  EXPECT_FALSE(future.valid());
+  done.Then(loop, Bind(&EventLoop::QuitSoon, loop));
+
+  std::thread producer([&promise] {
+    promise.SetValue(make_unique(new int(7)));
+  });
+  EXPECT_TRUE(Run());
+  producer.join();
+  EXPECT_EQ(7, result);
+
+  // A ready future posts its continuation right away.
+  MakeReadyFuture(3).Then(loop, [&result, loop](int value) {
+    result = value;
+    loop->QuitSoon();
+  });
+  EXPECT_TRUE(Run());
+  EXPECT_EQ(3, result);
+}
+
+TEST_F(FutureTest, Flatten) {
+  EventLoop* loop = loop_.get();
+  EventLoop* other = other_.get();
+  int result = 0;
+
+  // A stage that returns a Future is done once that Future has a value.
+  MakeReadyFuture(2)
+      .Then(loop, [other](int value) {
+        return PostWithFuture(other, [value] { return value + 40; });
+      })
+      .Then(loop, [&result, loop](int value) {
+        result = value;
+        loop->QuitSoon();
+      });
+  EXPECT_TRUE(Run());
+  EXPECT_EQ(42, result);
+}
+
+TEST_F(FutureTest, WhenAll) {
+  EventLoop* loop = loop_.get();
+  std::vector<Promise<int>> promises(3);
+  std::vector<Future<int>> futures;
+  for (Promise<int>& promise: promises)
+    futures.push_back(promise.future());
+
+  std::vector<int> result;
+  WhenAll(std::move(futures)).Then(loop, [&result, loop](std::vector<int> v) {
+    result = std::move(v);
+    loop->QuitSoon();
+  });
+
+  // The values keep the order of the futures, not of their arrival.
+  std::thread producer([&promises] {
+    for (int i = 2; i >= 0; --i)
+      promises[i].SetValue(i * 10);
+  });
+  EXPECT_TRUE(Run());
+  producer.join();
+  ASSERT_EQ(3u, result.size());
+  EXPECT_EQ(0, result[0]);
+  EXPECT_EQ(10, result[1]);
+  EXPECT_EQ(20, result[2]);
+
+  // Nothing to wait for.
+  result.push_back(1);
+  WhenAll(std::vector<Future<int>>()).Then(
+      loop, [&result, loop](std::vector<int> v) {
+        result = std::move(v);
+        loop->QuitSoon();
+      });
+  EXPECT_TRUE(Run());
+  EXPECT_TRUE(result.empty());
+}
+
+TEST_F(FutureTest, WhenAny) {
+  EventLoop* loop = loop_.get();
+  std::vector<Promise<int>> promises(3);
+  std::vector<Future<int>> futures;
+  for (Promise<int>& promise: promises)
+    futures.push_back(promise.future());
+
+  std::pair<size_t, int> result(0, 0);
+  WhenAny(std::move(futures)).Then(
+      loop, [&result, loop](std::pair<size_t, int> first) {
+        result = first;
+        loop->QuitSoon();
+      });
+
+  // Abandoned futures are skipped, and later values are dropped.
+  promises[0] = Promise<int>();
+  promises[2].SetValue(5);
+  promises[1].SetValue(6);
+  EXPECT_TRUE(Run());
+  EXPECT_EQ(2u, result.first);
+  EXPECT_EQ(5, result.second);
+}
+
+TEST_F(FutureTest, Abandon) {
+  EventLoop* loop = loop_.get();
+  std::shared_ptr<int> captured = std::make_shared<int>(0);
+  bool ran = false;
+
+  // The stages that depend on an abandoned Promise never run, and are
+  // released along with their continuations.
+  {
+    Promise<int> promise;
+    promise.future()
+        .Then(loop, [captured, &ran](int value) { ran = true; })
+        .Then(loop, [captured, &ran] { ran = true; });
+    EXPECT_EQ(3, captured.use_count());
+  }
+  EXPECT_EQ(1, captured.use_count());
+
+  // So is the result of WhenAll().
+  std::vector<Future<int>> futures;
+  futures.push_back(MakeReadyFuture(1));
+  {
+    Promise<int> promise;
+    futures.push_back(promise.future());
+  }
+  WhenAll(std::move(futures)).Then(
+      loop, [captured, &ran](std::vector<int> v) { ran = true; });
+  EXPECT_EQ(1, captured.use_count());
+
+  // Dropping a Future releases its value.
+  MakeReadyFuture(captured);
+  EXPECT_EQ(1, captured.use_count());
+
+  RunAllPending();
+  EXPECT_FALSE(ran);
+}
@@ -0,0 +1,71 @@
+#include "base/histogram.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+namespace {
+
+int bucket_of(uint64 value) {
+  return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+// Returns the largest value that goes in |bucket|.
+uint64 bucket_limit(int bucket) {
+  if (bucket == 0)
+    return 0;
+  if (bucket == 64)
+    return kuint64max;
+  return (static_cast<uint64>(1) << bucket) - 1;
+}
+
+}  // namespace
+
+Histogram::Snapshot::Snapshot()
+    : count(0), sum(0), max(0) {
+  for (int i = 0; i < kBuckets; ++i)
+    buckets[i] = 0;
+}
+
+double Histogram::Snapshot::Mean() const {
+  return count ? static_cast<double>(sum) / count : 0;
+}
+
+uint64 Histogram::Snapshot::Percentile(double percentile) const {
+  if (!count)
+    return 0;
+  uint64 rank = static_cast<uint64>(ceil(count * percentile / 100));
+  if (rank == 0)
+    rank = 1;
+  uint64 seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return std::min(bucket_limit(i), max);
+  }
+  return max;
+}
+
+Histogram::Histogram()
+    : sum_(0), max_(0) {
+  for (int i = 0; i < kBuckets; ++i)
+    buckets_[i] = 0;
+}
+
+void Histogram::Record(uint64 value) {
+  Add(&buckets_[bucket_of(value)], 1);
+  Add(&sum_, value);
+  if (value > max_.load(std::memory_order_relaxed))
+    max_.store(value, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::GetSnapshot() const {
+  Snapshot snapshot;
+  for (int i = 0; i < kBuckets; ++i) {
+    snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum = sum_.load(std::memory_order_relaxed);
+  snapshot.max = max_.load(std::memory_order_relaxed);
+  return snapshot;
+}
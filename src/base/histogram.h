@@ -0,0 +1,55 @@
+#ifndef BASE_HISTOGRAM_H
+#define BASE_HISTOGRAM_H
+
+#include <atomic>
+
+#include "base/base.h"
+
+// Counts values in power of two buckets: bucket 0 holds zeros, and bucket i
+// holds the values in [2^(i-1), 2^i). This is cheap enough to record on every
+// task; there are no locks or atomic read-modify-writes.
+//
+// Only one thread can Record() values, but any thread can take a snapshot.
+class Histogram {
+ public:
+  static const int kBuckets = 65;
+
+  struct Snapshot {
+    Snapshot();
+
+    // Returns zero if there are no values.
+    double Mean() const;
+
+    // Returns an upper bound for the |percentile| (0 to 100) of the values,
+    // which is at most twice the actual value.
+    uint64 Percentile(double percentile) const;
+
+    uint64 count;
+    uint64 sum;
+    uint64 max;
+    uint64 buckets[kBuckets];
+  };
+
+  Histogram();
+
+  void Record(uint64 value);
+
+  // The counters are read one at a time, so a snapshot taken while values are
+  // recorded might not include all of the last one.
+  Snapshot GetSnapshot() const;
+
+ private:
+  static void Add(std::atomic<uint64>* counter, uint64 value) {
+    // There's a single writer.
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64> sum_;
+  std::atomic<uint64> max_;
+  std::atomic<uint64> buckets_[kBuckets];
+
+  DISALLOW_COPY_AND_ASSIGN(Histogram);
+};
+
+#endif  // BASE_HISTOGRAM_H
@@ -0,0 +1,74 @@
+#include "base/histogram.h"
+
+#include <thread>
+
+#include "base/bind.h"
+#include "base/unittest.h"
+
+namespace {
+
+void record_values(Histogram* histogram, int count) {
+  for (int i = 0; i < count; ++i)
+    histogram->Record(i);
+}
+
+}  // namespace
+
+TEST(Histogram, Empty) {
+  Histogram histogram;
+  Histogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(0u, snapshot.count);
+  EXPECT_EQ(0, snapshot.Mean());
+  EXPECT_EQ(0u, snapshot.Percentile(50));
+}
+
+TEST(Histogram, Buckets) {
+  Histogram histogram;
+  histogram.Record(0);
+  histogram.Record(1);
+  histogram.Record(2);
+  histogram.Record(3);
+  histogram.Record(1000);
+  histogram.Record(kuint64max);
+
+  Histogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(6u, snapshot.count);
+  EXPECT_EQ(kuint64max, snapshot.max);
+  EXPECT_EQ(1u, snapshot.buckets[0]);
+  EXPECT_EQ(1u, snapshot.buckets[1]);
+  EXPECT_EQ(2u, snapshot.buckets[2]);
+  // 512 <= 1000 < 1024
+  EXPECT_EQ(1u, snapshot.buckets[10]);
+  EXPECT_EQ(1u, snapshot.buckets[64]);
+}
+
+TEST(Histogram, Percentile) {
+  Histogram histogram;
+  for (int i = 0; i < 90; ++i)
+    histogram.Record(10);
+  for (int i = 0; i < 10; ++i)
+    histogram.Record(100);
+
+  Histogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(19, snapshot.Mean());
+  // The upper bound of the bucket, [8, 16).
+  EXPECT_EQ(15u, snapshot.Percentile(50));
+  EXPECT_EQ(15u, snapshot.Percentile(90));
+  // Bounded by the maximum.
+  EXPECT_EQ(100u, snapshot.Percentile(91));
+  EXPECT_EQ(100u, snapshot.Percentile(100));
+  EXPECT_EQ(15u, snapshot.Percentile(0));
+}
+
+TEST(Histogram, SnapshotFromOtherThread) {
+  Histogram histogram;
+  std::thread writer(Bind(record_values, &histogram, 100000));
+  uint64 last = 0;
+  for (int i = 0; i < 100; ++i) {
+    Histogram::Snapshot snapshot = histogram.GetSnapshot();
+    EXPECT_LE(last, snapshot.count);
+    last = snapshot.count;
+  }
+  writer.join();
+  EXPECT_EQ(100000u, histogram.GetSnapshot().count);
+}
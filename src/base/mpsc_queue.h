@@ -0,0 +1,72 @@
+#ifndef BASE_MPSC_QUEUE_H
+#define BASE_MPSC_QUEUE_H
+
+#include <atomic>
+
+#include "base/base.h"
+
+// An intrusive, lock-free queue with multiple producers and a single consumer.
+// T must have a |T* next| member, which the queue owns while T is queued.
+//
+// Producers push nodes with a single compare-and-swap. The consumer takes the
+// whole backlog with a single exchange, and gets it in push order; nodes pushed
+// by the same thread are always taken in the order they were pushed.
+template<typename T>
+class MPSCQueue {
+ public:
+  MPSCQueue() : head_(NULL) {}
+
+  // Pushes |node|. Returns true if the queue was empty. Can be called from any
+  // thread.
+  bool Push(T* node) {
+    return PushList(node, node);
+  }
+
+  // Pushes the nodes from |first| to |last|, linked through their |next|
+  // member, as if they were pushed one by one starting from |first|. Returns
+  // true if the queue was empty. Can be called from any thread.
+  bool PushList(T* first, T* last) {
+    // Nodes are kept in reverse order; |first| goes in deepest.
+    T* reversed = Reverse(first, last);
+    T* head = head_.load();
+    do {
+      first->next = head;
+    } while (!head_.compare_exchange_weak(head, reversed));
+    return head == NULL;
+  }
+
+  // Removes all the nodes in the queue and returns the first one, or NULL. The
+  // nodes are linked through their |next| member, in push order. Must only be
+  // called by the consumer.
+  T* TakeAll() {
+    T* head = head_.exchange(NULL);
+    return head ? Reverse(head, NULL) : NULL;
+  }
+
+  // This is racy unless the producers are quiescent, but if it returns false
+  // then the consumer will find something on its next TakeAll().
+  bool empty() const {
+    return head_.load() == NULL;
+  }
+
+ private:
+  // Reverses the list from |first| up to and including |last|, or until the
+  // end of the list if |last| is NULL. Returns the new first node.
+  static T* Reverse(T* first, T* last) {
+    T* result = NULL;
+    T* node = first;
+    while (node) {
+      T* next = node == last ? NULL : node->next;
+      node->next = result;
+      result = node;
+      node = next;
+    }
+    return result;
+  }
+
+  std::atomic<T*> head_;
+
+  DISALLOW_COPY_AND_ASSIGN(MPSCQueue);
+};
+
+#endif  // BASE_MPSC_QUEUE_H
@@ -0,0 +1,97 @@
+#include <thread>
+#include <vector>
+
+#include "base/lock.h"
+#include "base/mpsc_queue.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+struct Node {
+  Node* next;
+};
+
+// The mutex and vector that EventLoop used before MPSCQueue.
+class LockedQueue {
+ public:
+  void Push(Node* node) {
+    ScopedLock lock(lock_);
+    nodes_.push_back(node);
+  }
+
+  size_t TakeAll() {
+    taken_.clear();
+    {
+      ScopedLock lock(lock_);
+      taken_.swap(nodes_);
+    }
+    return taken_.size();
+  }
+
+ private:
+  Lock lock_;
+  std::vector<Node*> nodes_;
+  std::vector<Node*> taken_;
+};
+
+class LockFreeQueue {
+ public:
+  void Push(Node* node) {
+    queue_.Push(node);
+  }
+
+  size_t TakeAll() {
+    size_t count = 0;
+    for (Node* node = queue_.TakeAll(); node; node = node->next)
+      count++;
+    return count;
+  }
+
+ private:
+  MPSCQueue<Node> queue_;
+};
+
+const int kIterations = 1 << 18;
+
+// Each benchmark thread is a producer, and a separate thread keeps consuming.
+template<typename Queue>
+void BM_Push(benchmark::State& state) {
+  static Queue* queue;
+  static std::thread* consumer;
+  static std::atomic<bool> stop;
+  // The nodes of every thread. The consumer can still be walking them after
+  // the other threads are done, so thread 0 frees them once it has joined.
+  static Node* nodes;
+
+  if (state.thread_index() == 0) {
+    queue = new Queue;
+    nodes = new Node[kIterations * state.threads()];
+    stop = false;
+    consumer = new std::thread([] {
+      while (!stop) {
+        if (!queue->TakeAll())
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  Node* node = nodes + kIterations * state.thread_index();
+  for (auto _: state)
+    queue->Push(node++);
+
+  if (state.thread_index() == 0) {
+    stop = true;
+    consumer->join();
+    delete consumer;
+    delete queue;
+    delete[] nodes;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK_TEMPLATE(BM_Push, LockedQueue)
+    ->Iterations(kIterations)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Push, LockFreeQueue)
+    ->Iterations(kIterations)->ThreadRange(1, 16)->UseRealTime();
@@ -0,0 +1,80 @@
+#include "base/mpsc_queue.h"
+
+#include <thread>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/unittest.h"
+
+namespace {
+
+struct Node {
+  Node() : next(NULL), producer(0), sequence(0) {}
+
+  Node* next;
+  int producer;
+  int sequence;
+};
+
+void produce(MPSCQueue<Node>* queue, std::vector<Node>* nodes, int producer) {
+  for (size_t i = 0; i < nodes->size(); ++i) {
+    (*nodes)[i].producer = producer;
+    (*nodes)[i].sequence = i;
+    queue->Push(&(*nodes)[i]);
+  }
+}
+
+}  // namespace
+
+TEST(MPSCQueue, Order) {
+  MPSCQueue<Node> queue;
+  Node nodes[5];
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.TakeAll());
+
+  EXPECT_TRUE(queue.Push(&nodes[0]));
+  EXPECT_FALSE(queue.Push(&nodes[1]));
+  EXPECT_FALSE(queue.empty());
+
+  // PushList() keeps the order of the list.
+  nodes[2].next = &nodes[3];
+  nodes[3].next = &nodes[4];
+  EXPECT_FALSE(queue.PushList(&nodes[2], &nodes[3]));
+
+  Node* node = queue.TakeAll();
+  EXPECT_TRUE(queue.empty());
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(&nodes[i], node);
+    node = node->next;
+  }
+  EXPECT_FALSE(node);
+
+  EXPECT_TRUE(queue.Push(&nodes[4]));
+  EXPECT_EQ(&nodes[4], queue.TakeAll());
+  EXPECT_FALSE(nodes[4].next);
+}
+
+TEST(MPSCQueue, ManyProducers) {
+  const int kProducers = 8;
+  const int kNodes = 10000;
+  MPSCQueue<Node> queue;
+  std::vector<std::vector<Node>> nodes(kProducers, std::vector<Node>(kNodes));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kProducers; ++i)
+    threads.push_back(std::thread(Bind(produce, &queue, &nodes[i], i)));
+
+  // Each producer's nodes are taken in order.
+  std::vector<int> next_sequence(kProducers, 0);
+  int taken = 0;
+  while (taken < kProducers * kNodes) {
+    for (Node* node = queue.TakeAll(); node; node = node->next) {
+      ASSERT_EQ(next_sequence[node->producer], node->sequence);
+      next_sequence[node->producer]++;
+      taken++;
+    }
+  }
+
+  for (std::thread& t: threads)
+    t.join();
+  EXPECT_TRUE(queue.empty());
+}
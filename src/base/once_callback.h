@@ -0,0 +1,182 @@
+#ifndef BASE_ONCE_CALLBACK_H
+#define BASE_ONCE_CALLBACK_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "base/base.h"
+#include "base/logging.h"
+
+template<typename Signature>
+class OnceCallback;
+
+// Holds any callable that takes |Args| and returns |R|, like a move-only
+// std::function that can only be run once: running it destroys the callable
+// and leaves the OnceCallback empty. That lets it hold move-only callables,
+// like the ones returned by BindOnce(), which move their bound arguments into
+// the call.
+//
+// An empty std::function or a null function pointer makes an empty
+// OnceCallback.
+//
+// Callables of up to kInlineSize bytes that can be moved without throwing are
+// kept inline, including Callbacks and lambdas with a few captures; others are
+// allocated.
+template<typename R, typename... Args>
+class OnceCallback<R(Args...)> {
+ public:
+  static const size_t kInlineSize = 4 * sizeof(void*);
+
+  OnceCallback() : ops_(NULL) {}
+
+  OnceCallback(std::nullptr_t) : ops_(NULL) {}
+
+  template<
+      typename F,
+      typename = typename std::enable_if<!std::is_same<
+          typename std::decay<F>::type, OnceCallback>::value>::type>
+  OnceCallback(F&& f) : ops_(NULL) {
+    if (IsNull(f))
+      return;
+    ops_ = OpsFor<typename std::decay<F>::type>();
+    Manager<typename std::decay<F>::type>::Create(&storage_,
+                                                  std::forward<F>(f));
+  }
+
+  OnceCallback(OnceCallback&& other) noexcept : ops_(other.ops_) {
+    if (ops_)
+      ops_->move(&other.storage_, &storage_);
+    other.ops_ = NULL;
+  }
+
+  OnceCallback& operator=(OnceCallback&& other) {
+    if (this != &other) {
+      Reset();
+      ops_ = other.ops_;
+      if (ops_)
+        ops_->move(&other.storage_, &storage_);
+      other.ops_ = NULL;
+    }
+    return *this;
+  }
+
+  ~OnceCallback() {
+    Reset();
+  }
+
+  void Reset() {
+    if (ops_)
+      ops_->destroy(&storage_);
+    ops_ = NULL;
+  }
+
+  explicit operator bool() const {
+    return ops_ != NULL;
+  }
+
+  // Runs the callable, and destroys it once it returns.
+  R operator()(Args... args) {
+    DCHECK(ops_);
+    const Ops* ops = ops_;
+    ops_ = NULL;
+    return ops->run(&storage_, std::forward<Args>(args)...);
+  }
+
+ private:
+  static const size_t kAlignment = alignof(void*);
+  typedef typename std::aligned_storage<kInlineSize, kAlignment>::type Storage;
+
+  struct Ops {
+    R (*run)(Storage* storage, Args&&... args);
+    void (*move)(Storage* from, Storage* to);
+    void (*destroy)(Storage* storage);
+  };
+
+  template<typename F,
+           bool = sizeof(F) <= kInlineSize && alignof(F) <= kAlignment &&
+                  std::is_nothrow_move_constructible<F>::value>
+  struct Manager {
+    static F* Get(Storage* storage) {
+      return reinterpret_cast<F*>(storage);
+    }
+
+    template<typename InF>
+    static void Create(Storage* storage, InF&& f) {
+      new (storage) F(std::forward<InF>(f));
+    }
+
+    static void Move(Storage* from, Storage* to) {
+      new (to) F(std::move(*Get(from)));
+      Get(from)->~F();
+    }
+
+    static void Destroy(Storage* storage) {
+      Get(storage)->~F();
+    }
+  };
+
+  template<typename F>
+  struct Manager<F, false> {
+    static F*& Get(Storage* storage) {
+      return *reinterpret_cast<F**>(storage);
+    }
+
+    template<typename InF>
+    static void Create(Storage* storage, InF&& f) {
+      Get(storage) = new F(std::forward<InF>(f));
+    }
+
+    static void Move(Storage* from, Storage* to) {
+      Get(to) = Get(from);
+    }
+
+    static void Destroy(Storage* storage) {
+      delete Get(storage);
+    }
+  };
+
+  template<typename F>
+  static R Run(Storage* storage, Args&&... args) {
+    // Destroys the callable after the call, even for non-void |R|. The cast
+    // drops what the callable returns when |R| is void.
+    struct Destroyer {
+      ~Destroyer() { Manager<F>::Destroy(storage); }
+      Storage* storage;
+    } destroyer = { storage };
+    return static_cast<R>(
+        (*Manager<F>::Get(storage))(std::forward<Args>(args)...));
+  }
+
+  template<typename F>
+  static bool IsNull(const F&) {
+    return false;
+  }
+
+  template<typename Signature>
+  static bool IsNull(const std::function<Signature>& f) {
+    return !f;
+  }
+
+  template<typename Function>
+  static bool IsNull(Function* f) {
+    return f == NULL;
+  }
+
+  template<typename F>
+  static const Ops* OpsFor() {
+    static const Ops ops = {
+      &Run<F>, &Manager<F>::Move, &Manager<F>::Destroy
+    };
+    return &ops;
+  }
+
+  const Ops* ops_;
+  Storage storage_;
+
+  DISALLOW_COPY_AND_ASSIGN(OnceCallback);
+};
+
+#endif  // BASE_ONCE_CALLBACK_H
@@ -0,0 +1,114 @@
+#include "base/once_callback.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "base/bind.h"
+#include "base/memory.h"
+#include "base/unittest.h"
+
+namespace {
+
+int add(unique_ptr<int> a, int b) {
+  return *a + b;
+}
+
+std::string concat(std::string a, std::string b) {
+  return a + b;
+}
+
+int twice(int a) {
+  return 2 * a;
+}
+
+// Counts its live instances.
+class Counted {
+ public:
+  explicit Counted(int* live) : live_(live) { (*live_)++; }
+  Counted(const Counted& other) : live_(other.live_) { (*live_)++; }
+  ~Counted() { (*live_)--; }
+
+  void operator()() const {}
+
+ private:
+  int* live_;
+};
+
+}  // namespace
+
+TEST(OnceCallback, Run) {
+  OnceCallback<int(int)> f = BindOnce(add, make_unique(new int(1)));
+  EXPECT_TRUE(f);
+  EXPECT_EQ(3, f(2));
+  EXPECT_FALSE(f);
+
+  // Regular Callbacks and lambdas work too.
+  OnceCallback<std::string(std::string)> g = Bind(concat, "a");
+  EXPECT_EQ("ab", g("b"));
+  int value = 0;
+  OnceCallback<void()> h = [&value] { value = 5; };
+  h();
+  EXPECT_EQ(5, value);
+
+  OnceCallback<void()> empty;
+  EXPECT_FALSE(empty);
+  empty = nullptr;
+  EXPECT_FALSE(empty);
+}
+
+TEST(OnceCallback, Lifetime) {
+  int live = 0;
+  {
+    OnceCallback<void()> f = Counted(&live);
+    EXPECT_EQ(1, live);
+    // Moving keeps a single instance.
+    OnceCallback<void()> g = std::move(f);
+    EXPECT_FALSE(f);
+    EXPECT_EQ(1, live);
+    f = std::move(g);
+    EXPECT_EQ(1, live);
+    // Running it destroys it.
+    f();
+    EXPECT_EQ(0, live);
+
+    f = Counted(&live);
+    EXPECT_EQ(1, live);
+    f.Reset();
+    EXPECT_EQ(0, live);
+    f = Counted(&live);
+  }
+  EXPECT_EQ(0, live);
+}
+
+TEST(OnceCallback, Large) {
+  // Too large to be kept inline, but used the same way.
+  std::string parts[8] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+  std::string result;
+  OnceCallback<void(int)> f = [parts, &result](int count) {
+    for (int i = 0; i < count; ++i)
+      result += parts[i];
+  };
+  OnceCallback<void(int)> g = std::move(f);
+  g(3);
+  EXPECT_EQ("abc", result);
+}
+
+TEST(OnceCallback, EmptySource) {
+  // Empty callables make empty OnceCallbacks, so callers that skip empty
+  // callbacks don't run them.
+  OnceCallback<void()> f = std::function<void()>();
+  EXPECT_FALSE(f);
+  int (*null_function)(int) = NULL;
+  OnceCallback<int(int)> g = null_function;
+  EXPECT_FALSE(g);
+
+  OnceCallback<int(int)> h = std::function<int(int)>(twice);
+  EXPECT_TRUE(h);
+  EXPECT_EQ(4, h(2));
+  int (*function)(int) = twice;
+  g = OnceCallback<int(int)>(function);
+  EXPECT_EQ(6, g(3));
+  g = twice;
+  EXPECT_EQ(8, g(4));
+}
@@ -0,0 +1,791 @@
+#include "base/poller.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "base/logging.h"
+
+namespace {
+
+// Returns |timeout| in whole milliseconds, rounding up so that waiting for it
+// doesn't return early.
+int ToTimeoutMs(const PreciseTimeDelta& timeout) {
+  if (timeout.count() < 0)
+    return -1;
+  int64 ms = (timeout.count() + 999) / 1000;
+  return ms > kint32max ? kint32max : ms;
+}
+
+template<typename Timespec>
+void ToTimespec(const PreciseTimeDelta& timeout, Timespec* ts) {
+  ts->tv_sec = timeout.count() / 1000000;
+  ts->tv_nsec = (timeout.count() % 1000000) * 1000;
+}
+
+// Keeps the descriptors in a pollfd array and scans it after every poll(2).
+class PollPoller : public Poller {
+ public:
+  PollPoller() {}
+  virtual ~PollPoller() {}
+
+  virtual void Add(int fd, int events, void* data) override {
+    DCHECK(fd >= 0);
+    if (static_cast<size_t>(fd) >= index_.size())
+      index_.resize(fd + 1);
+    DCHECK(!index_[fd]);
+    index_[fd] = fds_.size() + 1;
+    fds_.push_back(pollfd());
+    fds_.back().fd = fd;
+    fds_.back().events = events;
+    fds_.back().revents = 0;
+    data_.push_back(data);
+  }
+
+  virtual void Modify(int fd, int events, void* data) override {
+    size_t i = IndexOf(fd);
+    DCHECK(i);
+    fds_[i - 1].events = events;
+    data_[i - 1] = data;
+  }
+
+  virtual void Remove(int fd) override {
+    size_t i = IndexOf(fd);
+    if (!i)
+      return;
+    index_[fd] = 0;
+    if (i != fds_.size()) {
+      fds_[i - 1] = fds_.back();
+      data_[i - 1] = data_.back();
+      index_[fds_[i - 1].fd] = i;
+    }
+    fds_.pop_back();
+    data_.pop_back();
+  }
+
+  virtual bool Wait(const PreciseTimeDelta& timeout,
+                    std::vector<Event>* events) override {
+#if defined(__linux__)
+    timespec ts;
+    ToTimespec(timeout, &ts);
+    int ret = ppoll(fds_.empty() ? NULL : &fds_.front(), fds_.size(),
+                    timeout.count() < 0 ? NULL : &ts, NULL);
+#else
+    int ret = poll(fds_.empty() ? NULL : &fds_.front(), fds_.size(),
+                   ToTimeoutMs(timeout));
+#endif
+    if (ret == -1) {
+      if (errno == EINTR || errno == EAGAIN)
+        return true;
+      DLOGE(ERROR) << "poll failed";
+      return false;
+    }
+    for (size_t i = 0; i < fds_.size(); ++i) {
+      if (fds_[i].revents) {
+        events->push_back(Event());
+        events->back().data = data_[i];
+        events->back().revents = fds_[i].revents;
+      }
+    }
+    return true;
+  }
+
+  virtual size_t size() const override { return fds_.size(); }
+
+ private:
+  // Returns the index of |fd| in |fds_| plus one, or zero.
+  size_t IndexOf(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= index_.size())
+      return 0;
+    return index_[fd];
+  }
+
+  std::vector<pollfd> fds_;
+  std::vector<void*> data_;
+  // Indexed by fd: its index in |fds_| and |data_| plus one, or zero. This
+  // only grows, so that adding descriptors again doesn't allocate.
+  std::vector<size_t> index_;
+
+  DISALLOW_COPY_AND_ASSIGN(PollPoller);
+};
+
+#if defined(__linux__)
+
+int ToEpollEvents(int events) {
+  int result = 0;
+  if (events & POLLIN) result |= EPOLLIN;
+  if (events & POLLPRI) result |= EPOLLPRI;
+  if (events & POLLOUT) result |= EPOLLOUT;
+  return result;
+}
+
+int FromEpollEvents(uint32 events) {
+  int result = 0;
+  if (events & EPOLLIN) result |= POLLIN;
+  if (events & EPOLLPRI) result |= POLLPRI;
+  if (events & EPOLLOUT) result |= POLLOUT;
+  if (events & EPOLLERR) result |= POLLERR;
+  if (events & EPOLLHUP) result |= POLLHUP;
+  return result;
+}
+
+// Keeps the descriptors registered in the kernel, which only returns the ready
+// ones.
+class EpollPoller : public Poller {
+ public:
+  explicit EpollPoller(int epoll_fd)
+      : epoll_fd_(epoll_fd),
+        size_(0),
+        buffer_(kMinBufferSize),
+        has_pwait2_(true) {}
+
+  virtual ~EpollPoller() {
+    close(epoll_fd_);
+  }
+
+  virtual void Add(int fd, int events, void* data) override {
+    size_++;
+    epoll_event ev;
+    ev.events = ToEpollEvents(events);
+    ev.data.ptr = data;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0)
+      return;
+    if (errno == EEXIST) {
+      // A previous registration of the same open file survived a close() of
+      // its descriptor.
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0)
+        return;
+    }
+    AddUnpollable(fd, events, data, errno);
+  }
+
+  virtual void Modify(int fd, int events, void* data) override {
+    auto it = unpollable_.find(fd);
+    if (it != unpollable_.end()) {
+      it->second.data = data;
+      if (!(it->second.revents & (POLLERR | POLLNVAL)))
+        it->second.revents = events & (POLLIN | POLLOUT);
+      return;
+    }
+    epoll_event ev;
+    ev.events = ToEpollEvents(events);
+    ev.data.ptr = data;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) != 0) {
+      // The descriptor was closed since it was added.
+      AddUnpollable(fd, events, data, errno);
+    }
+  }
+
+  virtual void Remove(int fd) override {
+    size_--;
+    if (!unpollable_.empty() && unpollable_.erase(fd))
+      return;
+    // This fails if |fd| has been closed already, in which case the kernel
+    // has already dropped it.
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+  }
+
+  virtual bool Wait(const PreciseTimeDelta& timeout,
+                    std::vector<Event>* events) override {
+    PreciseTimeDelta wait = unpollable_.empty() ? timeout : PreciseTimeDelta();
+    int ret = -1;
+    bool use_epoll_wait = true;
+#if defined(__NR_epoll_pwait2)
+    // epoll_wait(2) is enough for whole milliseconds.
+    if (has_pwait2_ && wait.count() % 1000 != 0) {
+      timespec ts;
+      ToTimespec(wait, &ts);
+      ret = syscall(__NR_epoll_pwait2, epoll_fd_, &buffer_.front(),
+                    buffer_.size(), wait.count() < 0 ? NULL : &ts, NULL, 0);
+      // Besides kernels without it (ENOSYS), seccomp filters that predate it
+      // refuse it with EPERM, and some older kernels with EINVAL. If
+      // epoll_wait(2) fails too then the error wasn't about epoll_pwait2.
+      has_pwait2_ = ret != -1 ||
+                    (errno != ENOSYS && errno != EPERM && errno != EINVAL);
+      use_epoll_wait = !has_pwait2_;
+    }
+#endif
+    if (use_epoll_wait) {
+      ret = epoll_wait(epoll_fd_, &buffer_.front(), buffer_.size(),
+                       ToTimeoutMs(wait));
+    }
+    if (ret == -1) {
+      if (errno != EINTR) {
+        DLOGE(ERROR) << "epoll_wait failed";
+        return false;
+      }
+      ret = 0;
+    }
+    for (int i = 0; i < ret; ++i) {
+      events->push_back(Event());
+      events->back().data = buffer_[i].data.ptr;
+      events->back().revents = FromEpollEvents(buffer_[i].events);
+    }
+    for (auto& i: unpollable_)
+      events->push_back(i.second);
+    if (ret == (int) buffer_.size() && buffer_.size() < kMaxBufferSize)
+      buffer_.resize(buffer_.size() * 2);
+    return true;
+  }
+
+  virtual size_t size() const override { return size_; }
+
+ private:
+  static const size_t kMinBufferSize = 64;
+  static const size_t kMaxBufferSize = 4096;
+
+  // epoll(7) refuses some descriptors that poll(2) accepts. These are
+  // reported on every Wait() with the events that poll(2) would return.
+  void AddUnpollable(int fd, int events, void* data, int error) {
+    Event event = Event();
+    event.data = data;
+    if (error == EPERM) {
+      // Regular files and directories are always ready.
+      event.revents = events & (POLLIN | POLLOUT);
+    } else if (error == EBADF) {
+      event.revents = POLLNVAL;
+    } else {
+      DLOG(ERROR) << "epoll_ctl failed for fd " << fd << ", errno: " << error;
+      event.revents = POLLERR;
+    }
+    unpollable_[fd] = event;
+  }
+
+  int epoll_fd_;
+  size_t size_;
+  std::vector<epoll_event> buffer_;
+  // False once epoll_pwait2(2) turned out to be missing or forbidden.
+  bool has_pwait2_;
+  std::unordered_map<int, Event> unpollable_;
+
+  DISALLOW_COPY_AND_ASSIGN(EpollPoller);
+};
+
+#if defined(__NR_io_uring_setup)
+
+// Owns an io_uring and its mapped rings. Registered descriptors have a one-shot
+// poll request each, which is armed again on the next Wait() after it fires.
+// Submission entries are only written to the ring; Wait() submits them all
+// with the io_uring_enter(2) call that waits for completions.
+class IoUringPoller : public Poller {
+ public:
+  virtual ~IoUringPoller() {
+    if (sqes_ != MAP_FAILED)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != MAP_FAILED)
+      munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+
+  // Returns NULL if the kernel doesn't support io_uring, or lacks the features
+  // needed here.
+  static unique_ptr<Poller> Create() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCompletionEntries;
+    int fd = syscall(__NR_io_uring_setup, kSubmissionEntries, &params);
+    if (fd == -1) {
+      DLOGE(WARNING) << "io_uring_setup failed";
+      return NULL;
+    }
+    unique_ptr<IoUringPoller> poller(new IoUringPoller(fd));
+    // EXT_ARG is needed to wait with a timeout without submitting a timeout
+    // request; NODROP keeps completions when the ring overflows.
+    const uint32 kFeatures = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((params.features & kFeatures) != kFeatures) {
+      DLOG(WARNING) << "io_uring lacks the required features";
+      return NULL;
+    }
+    if (!poller->MapRings(params))
+      return NULL;
+    return make_unique<Poller>(poller.release());
+  }
+
+  virtual void Add(int fd, int events, void* data) override {
+    DCHECK(fd >= 0);
+    if (static_cast<size_t>(fd) >= registrations_.size())
+      registrations_.resize(fd + 1);
+    DCHECK(!registrations_[fd]);
+    Registration* registration = NewRegistration(fd, events, data);
+    registrations_[fd] = registration;
+    registered_++;
+    to_arm_.push_back(registration);
+  }
+
+  virtual void Modify(int fd, int events, void* data) override {
+    Registration* registration = Find(fd);
+    DCHECK(registration);
+    if (registration->armed && registration->events != events) {
+      // The armed request can't change its events; replace it.
+      Remove(fd);
+      Add(fd, events, data);
+      return;
+    }
+    registration->events = events;
+    registration->data = data;
+  }
+
+  virtual void Remove(int fd) override {
+    Registration* registration = Find(fd);
+    if (!registration)
+      return;
+    registrations_[fd] = NULL;
+    registered_--;
+    registration->removed = true;
+    // Unarmed registrations are in |to_arm_|, which releases them. Armed ones
+    // are released when their request completes.
+    if (registration->armed) {
+      QueueCancel(IORING_OP_POLL_REMOVE,
+                  reinterpret_cast<uintptr_t>(registration));
+    }
+  }
+
+  virtual bool Wait(const PreciseTimeDelta& timeout,
+                    std::vector<Event>* events) override {
+    // Completions reaped while the submission ring was full.
+    events->insert(events->end(), reaped_.begin(), reaped_.end());
+    bool has_reaped = !reaped_.empty();
+    reaped_.clear();
+
+    // Cancellations that didn't fit in the ring go first. NextSqe() can reap
+    // completions, which appends to |to_arm_|.
+    FlushCancellations();
+
+    arming_.swap(to_arm_);
+    for (size_t i = 0; i < arming_.size(); ++i) {
+      Registration* registration = arming_[i];
+      if (registration->removed) {
+        spare_registrations_.push_back(registration);
+        continue;
+      }
+      io_uring_sqe* sqe = NextSqe();
+      if (!sqe) {
+        // Try again on the next Wait().
+        to_arm_.insert(to_arm_.end(), arming_.begin() + i, arming_.end());
+        break;
+      }
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = registration->fd;
+      sqe->poll32_events = registration->events;
+      sqe->user_data = reinterpret_cast<uintptr_t>(registration);
+      registration->armed = true;
+    }
+    arming_.clear();
+
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    __kernel_timespec ts;
+    uint32 flags = 0;
+    uint32 min_complete = 0;
+    if (timeout.count() != 0 && !has_reaped && CompletionsReady() == 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+      min_complete = 1;
+      if (timeout.count() > 0) {
+        ToTimespec(timeout, &ts);
+        arg.ts = reinterpret_cast<uintptr_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+      }
+    }
+    if (!Enter(min_complete, flags, &arg))
+      return false;
+    ReapCompletions(events);
+    return true;
+  }
+
+  virtual size_t size() const override { return registered_; }
+
+  virtual bool SupportsCompletions() const override { return true; }
+
+  virtual bool Submit(Operation op, int fd, void* buffer, size_t size,
+                      void* data) override {
+    DCHECK(!(reinterpret_cast<uintptr_t>(data) & kCompletionTag));
+    io_uring_sqe* sqe = NextSqe();
+    if (!sqe)
+      return false;
+    sqe->fd = fd;
+    sqe->user_data = reinterpret_cast<uintptr_t>(data) | kCompletionTag;
+    switch (op) {
+      case READ:
+      case WRITE:
+        sqe->opcode = op == READ ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+        sqe->len = size;
+        // Use and update the current file position, like read(2) does.
+        sqe->off = static_cast<uint64>(-1);
+        break;
+      case ACCEPT:
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        break;
+    }
+    return true;
+  }
+
+  virtual void Cancel(void* data) override {
+    QueueCancel(IORING_OP_ASYNC_CANCEL,
+                reinterpret_cast<uintptr_t>(data) | kCompletionTag);
+  }
+
+ private:
+  static const uint32 kSubmissionEntries = 256;
+  static const uint32 kCompletionEntries = 4096;
+  // Set in the user_data of submitted operations. Registrations are aligned,
+  // and requests with a user_data of zero are ignored.
+  static const uintptr_t kCompletionTag = 1;
+  // How many times NextSqe() enters the kernel to make room in a full
+  // submission ring before giving up.
+  static const int kMaxSubmitAttempts = 4;
+
+  struct Registration {
+    Registration(int fd, int events, void* data)
+        : fd(fd), events(events), data(data), armed(false), removed(false) {}
+
+    int fd;
+    int events;
+    void* data;
+    // True while its poll request is in the kernel.
+    bool armed;
+    bool removed;
+  };
+
+  // A request to cancel the request with |user_data| that didn't fit in the
+  // submission ring.
+  struct Cancellation {
+    uint8 opcode;
+    uintptr_t user_data;
+  };
+
+  explicit IoUringPoller(int ring_fd)
+      : ring_fd_(ring_fd),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+        sq_tail_(0),
+        registered_(0) {}
+
+  Registration* Find(int fd) const {
+    if (fd < 0 || static_cast<size_t>(fd) >= registrations_.size())
+      return NULL;
+    return registrations_[fd];
+  }
+
+  // Reuses a released Registration if there is one.
+  Registration* NewRegistration(int fd, int events, void* data) {
+    if (spare_registrations_.empty()) {
+      registration_storage_.push_back(
+          make_unique(new Registration(fd, events, data)));
+      return registration_storage_.back().get();
+    }
+    Registration* registration = spare_registrations_.back();
+    spare_registrations_.pop_back();
+    *registration = Registration(fd, events, data);
+    return registration;
+  }
+
+  bool MapRings(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32);
+    cq_ring_size_ = params.cq_off.cqes +
+                    params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      DLOGE(ERROR) << "mmap failed";
+      return false;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        DLOGE(ERROR) << "mmap failed";
+        return false;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+      DLOGE(ERROR) << "mmap failed";
+      return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<uint32*>(sq + params.sq_off.head);
+    sq_tail_ptr_ = reinterpret_cast<uint32*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sq_tail_ = *sq_tail_ptr_;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // Returns a cleared submission entry at the tail of the ring, or NULL if the
+  // ring is full and the kernel doesn't take its entries. This only enters the
+  // kernel if the ring is full; completions reaped meanwhile are kept in
+  // |reaped_| for the next Wait().
+  io_uring_sqe* NextSqe() {
+    for (int attempt = 0; SubmissionRingFull(); ++attempt) {
+      if (attempt == kMaxSubmitAttempts) {
+        DLOG(WARNING) << "io_uring submission ring is full";
+        return NULL;
+      }
+      // The kernel refuses new entries with EBUSY until the completions
+      // that overflowed are reaped.
+      bool entered = Enter(0, 0, NULL);
+      ReapCompletions(&reaped_);
+      if (!entered && SubmissionRingFull())
+        return NULL;
+    }
+    uint32 index = sq_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    sq_tail_++;
+    return sqe;
+  }
+
+  // Submits the queued entries and waits for |min_complete| completions.
+  bool Enter(uint32 min_complete, uint32 flags, io_uring_getevents_arg* arg) {
+    __atomic_store_n(sq_tail_ptr_, sq_tail_, __ATOMIC_RELEASE);
+    uint32 to_submit =
+        sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (!to_submit && !min_complete)
+      return true;
+    int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                      flags, (flags & IORING_ENTER_EXT_ARG) ? arg : NULL,
+                      sizeof(*arg));
+    // ETIME is the timeout expiring, and EBUSY means that completions have
+    // to be reaped before submitting more.
+    if (ret == -1 && errno != EINTR && errno != ETIME && errno != EBUSY &&
+        errno != EAGAIN) {
+      DLOGE(ERROR) << "io_uring_enter failed";
+      return false;
+    }
+    return true;
+  }
+
+  bool SubmissionRingFull() const {
+    return sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >=
+           sq_entries_;
+  }
+
+  // Queues a request of type |opcode| to cancel the request with |user_data|,
+  // or keeps it for the next Wait() if the ring is full.
+  void QueueCancel(uint8 opcode, uintptr_t user_data) {
+    Cancellation cancellation = { opcode, user_data };
+    to_cancel_.push_back(cancellation);
+    FlushCancellations();
+  }
+
+  void FlushCancellations() {
+    while (!to_cancel_.empty()) {
+      io_uring_sqe* sqe = NextSqe();
+      if (!sqe)
+        return;
+      // Reaping completions in NextSqe() may have dropped the rest; then
+      // |sqe| stays a no-op, which is ignored.
+      if (to_cancel_.empty())
+        return;
+      sqe->opcode = to_cancel_.back().opcode;
+      sqe->fd = -1;
+      sqe->addr = to_cancel_.back().user_data;
+      to_cancel_.pop_back();
+    }
+  }
+
+  // Drops the pending cancellation of |user_data|, whose request has
+  // completed. Its address might be reused by a later request.
+  void DropCancellation(uintptr_t user_data) {
+    for (size_t i = 0; i < to_cancel_.size(); ++i) {
+      if (to_cancel_[i].user_data == user_data) {
+        to_cancel_.erase(to_cancel_.begin() + i);
+        return;
+      }
+    }
+  }
+
+  uint32 CompletionsReady() const {
+    return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+  }
+
+  void ReapCompletions(std::vector<Event>* events) {
+    uint32 head = *cq_head_;
+    uint32 tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      if (!cqe.user_data)
+        continue;
+      if (!to_cancel_.empty())
+        DropCancellation(cqe.user_data);
+      if (cqe.user_data & kCompletionTag) {
+        events->push_back(Event());
+        events->back().data =
+            reinterpret_cast<void*>(cqe.user_data & ~kCompletionTag);
+        events->back().result = cqe.res;
+        continue;
+      }
+      Registration* registration =
+          reinterpret_cast<Registration*>(cqe.user_data);
+      registration->armed = false;
+      if (registration->removed) {
+        spare_registrations_.push_back(registration);
+        continue;
+      }
+      to_arm_.push_back(registration);
+      int revents = cqe.res;
+      if (revents < 0)
+        revents = cqe.res == -EBADF ? POLLNVAL : POLLERR;
+      if (!revents)
+        continue;
+      events->push_back(Event());
+      events->back().data = registration->data;
+      events->back().revents = revents;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  int ring_fd_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  // Pointers into the mapped rings.
+  uint32* sq_head_;
+  uint32* sq_tail_ptr_;
+  uint32 sq_mask_;
+  uint32 sq_entries_;
+  uint32* sq_array_;
+  uint32* cq_head_;
+  uint32* cq_tail_;
+  uint32 cq_mask_;
+  io_uring_cqe* cqes_;
+
+  // The tail of the submission ring, which the kernel sees on Enter().
+  uint32 sq_tail_;
+
+  // Indexed by fd. Like the other containers here, it only grows, so that a
+  // steady stream of registrations doesn't allocate.
+  std::vector<Registration*> registrations_;
+  size_t registered_;
+  // Registrations without a poll request in the kernel, including removed
+  // ones that are released on the next Wait(). |arming_| holds them while
+  // they're armed.
+  std::vector<Registration*> to_arm_;
+  std::vector<Registration*> arming_;
+  // Owns every Registration. The removed ones are kept in
+  // |spare_registrations_| for reuse once their poll request is done.
+  std::vector<unique_ptr<Registration>> registration_storage_;
+  std::vector<Registration*> spare_registrations_;
+  // Cancellations and completions deferred by a full submission ring.
+  std::vector<Cancellation> to_cancel_;
+  std::vector<Event> reaped_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringPoller);
+};
+
+#endif  // __NR_io_uring_setup
+
+#endif  // __linux__
+
+}  // namespace
+
+Poller::~Poller() {}
+
+bool Poller::SupportsCompletions() const {
+  return false;
+}
+
+bool Poller::Submit(Operation op, int fd, void* buffer, size_t size,
+                    void* data) {
+  NOTREACHED();
+  return false;
+}
+
+void Poller::Cancel(void* data) {
+  NOTREACHED();
+}
+
+// static
+unique_ptr<Poller> Poller::Create(Backend backend) {
+  if (backend == IO_URING_OR_DEFAULT) {
+    unique_ptr<Poller> poller = Create(IO_URING);
+    if (poller)
+      return poller;
+    DLOG(INFO) << "io_uring is not available, using the default backend";
+    backend = DEFAULT;
+  }
+
+  if (backend == DEFAULT) {
+#if defined(__linux__)
+    backend = EPOLL;
+#else
+    backend = POLL;
+#endif
+  }
+
+  switch (backend) {
+    case POLL:
+      return make_unique<Poller>(new PollPoller);
+
+    case EPOLL: {
+#if defined(__linux__)
+      int fd = epoll_create1(EPOLL_CLOEXEC);
+      if (fd == -1) {
+        DLOGE(ERROR) << "epoll_create1 failed";
+        return NULL;
+      }
+      return make_unique<Poller>(new EpollPoller(fd));
+#else
+      DLOG(ERROR) << "epoll is not available on this platform";
+      return NULL;
+#endif
+    }
+
+    case IO_URING:
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+      return IoUringPoller::Create();
+#else
+      DLOG(ERROR) << "io_uring is not available on this platform";
+      return NULL;
+#endif
+
+    case DEFAULT:
+    case IO_URING_OR_DEFAULT:
+      break;
+  }
+
+  NOTREACHED();
+  return NULL;
+}
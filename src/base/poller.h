@@ -0,0 +1,106 @@
+#ifndef BASE_POLLER_H
+#define BASE_POLLER_H
+
+#include <vector>
+
+#include "base/base.h"
+#include "base/memory.h"
+#include "base/time.h"
+
+// A Poller waits for readiness of a set of file descriptors. It wraps one of
+// the kernel APIs available (poll(2), epoll(7), io_uring(7)) and is used by
+// EventLoop.
+//
+// Events are always expressed with the poll(2) flags (POLLIN, POLLOUT, POLLERR,
+// POLLHUP and POLLNVAL), whatever the backend. Each registered descriptor
+// carries an opaque |data| pointer that is returned with its events, so that
+// callers don't have to look up the descriptor again.
+//
+// Pollers are not thread safe.
+class Poller {
+ public:
+  enum Backend {
+    // The most scalable backend available on the current platform.
+    DEFAULT,
+    // poll(2). Each Wait() costs O(number of registered descriptors).
+    POLL,
+    // epoll(7), only on linux. Each Wait() costs O(number of ready
+    // descriptors).
+    EPOLL,
+    // io_uring(7), only on linux 5.11 or later. Descriptors are watched with
+    // one-shot poll requests that are re-armed as needed. Every request queued
+    // since the last Wait() is submitted by the same io_uring_enter(2) call
+    // that waits. This is the only backend that supports Submit().
+    IO_URING,
+    // IO_URING if the running kernel supports it, or DEFAULT otherwise.
+    IO_URING_OR_DEFAULT,
+  };
+
+  // The operations that can be submitted to backends that support them.
+  enum Operation {
+    READ,
+    WRITE,
+    // Accepts a connection. The new descriptor is non-blocking and
+    // close-on-exec.
+    ACCEPT,
+  };
+
+  struct Event {
+    void* data;
+    // The poll(2) flags of a ready descriptor, or zero for the completion of
+    // an operation.
+    int revents;
+    // The result of a completed operation: what its syscall would return, or
+    // -errno on failure.
+    int result;
+  };
+
+  virtual ~Poller();
+
+  // Returns a new Poller using |backend|, or NULL if it isn't available.
+  static unique_ptr<Poller> Create(Backend backend);
+
+  // Starts watching |fd| for |events|. |fd| must not be registered yet.
+  // Descriptors that can't be watched (e.g. closed descriptors) are reported
+  // with POLLNVAL by Wait(), just like poll(2) does.
+  virtual void Add(int fd, int events, void* data) = 0;
+
+  // Changes the |events| and |data| of a registered |fd|.
+  virtual void Modify(int fd, int events, void* data) = 0;
+
+  // Stops watching |fd|. This is fine to call after |fd| has been closed.
+  virtual void Remove(int fd) = 0;
+
+  // Waits up to |timeout| for events, or forever if it's negative. The
+  // timeout has microsecond resolution with ppoll(2), epoll_pwait2(2) (linux
+  // 5.11 or later) and io_uring; elsewhere it is rounded up to milliseconds.
+  // Appends the ready descriptors to |events| and returns false on failure.
+  virtual bool Wait(const PreciseTimeDelta& timeout,
+                    std::vector<Event>* events) = 0;
+
+  // Returns the number of registered descriptors.
+  virtual size_t size() const = 0;
+
+  // Returns true if Submit() and Cancel() can be used.
+  virtual bool SupportsCompletions() const;
+
+  // Starts |op| on |fd|. Its completion is reported by Wait() with |data|,
+  // which must be aligned to at least 2 bytes. For READ and WRITE |buffer|
+  // holds |size| bytes and must stay valid until then; ACCEPT ignores both.
+  // Returns false if the kernel can't take more requests right now; |op| is
+  // not started nor reported then.
+  virtual bool Submit(Operation op, int fd, void* buffer, size_t size,
+                      void* data);
+
+  // Cancels the operation submitted with |data|, if it hasn't completed yet.
+  // Its completion is still reported, with -ECANCELED if it was cancelled.
+  virtual void Cancel(void* data);
+
+ protected:
+  Poller() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Poller);
+};
+
+#endif  // BASE_POLLER_H
@@ -0,0 +1,214 @@
+#include "base/poller.h"
+
+#include <map>
+#include <set>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "base/time.h"
+#include "base/unittest.h"
+
+class PollerTest : public testing::TestWithParam<Poller::Backend> {
+ public:
+  void SetUp() override {
+    poller_ = Poller::Create(GetParam());
+    ASSERT_TRUE(poller_.get());
+    ASSERT_EQ(0, pipe(fds_));
+  }
+
+  void TearDown() override {
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  // Returns the revents for |data| after a non-blocking Wait(), or -1 if
+  // |data| wasn't reported.
+  int WaitFor(void* data) {
+    std::vector<Poller::Event> events;
+    EXPECT_TRUE(poller_->Wait(PreciseTimeDelta(), &events));
+    for (const Poller::Event& event: events) {
+      if (event.data == data)
+        return event.revents;
+    }
+    return -1;
+  }
+
+  unique_ptr<Poller> poller_;
+  int fds_[2];
+  int tag_;
+};
+
+INSTANTIATE_TEST_CASE_P(Backends, PollerTest,
+                        testing::ValuesIn(AvailablePollerBackends()));
+
+TEST_P(PollerTest, ReadWrite) {
+  poller_->Add(fds_[0], POLLIN, &fds_[0]);
+  poller_->Add(fds_[1], POLLOUT, &fds_[1]);
+  EXPECT_EQ(2u, poller_->size());
+  EXPECT_EQ(-1, WaitFor(&fds_[0]));
+  EXPECT_EQ(POLLOUT, WaitFor(&fds_[1]));
+
+  uint8 byte = 0;
+  ASSERT_EQ(1, write(fds_[1], &byte, 1));
+  EXPECT_EQ(POLLIN, WaitFor(&fds_[0]));
+
+  // Level triggered: it's still readable.
+  EXPECT_EQ(POLLIN, WaitFor(&fds_[0]));
+  ASSERT_EQ(1, read(fds_[0], &byte, 1));
+  EXPECT_EQ(-1, WaitFor(&fds_[0]));
+}
+
+TEST_P(PollerTest, ModifyAndRemove) {
+  poller_->Add(fds_[1], POLLIN, &fds_[1]);
+  EXPECT_EQ(-1, WaitFor(&fds_[1]));
+
+  poller_->Modify(fds_[1], POLLOUT, &tag_);
+  EXPECT_EQ(-1, WaitFor(&fds_[1]));
+  EXPECT_EQ(POLLOUT, WaitFor(&tag_));
+
+  poller_->Remove(fds_[1]);
+  EXPECT_EQ(0u, poller_->size());
+  EXPECT_EQ(-1, WaitFor(&tag_));
+
+  // Can be added again.
+  poller_->Add(fds_[1], POLLOUT, &fds_[1]);
+  EXPECT_EQ(POLLOUT, WaitFor(&fds_[1]));
+}
+
+TEST_P(PollerTest, Timeout) {
+  poller_->Add(fds_[0], POLLIN, &fds_[0]);
+  std::vector<Poller::Event> events;
+  // Sub-millisecond timeouts don't become non-blocking. A wait can still end
+  // early when interrupted.
+  const int kTimeouts[] = { 250, 1500 };
+  for (int us: kTimeouts) {
+    uint64 start = MonotonicNanos();
+    int waits = 0;
+    do {
+      EXPECT_TRUE(poller_->Wait(PreciseTimeDelta(us), &events));
+      waits++;
+    } while (MonotonicNanos() - start < us * 1000u);
+    EXPECT_GT(5, waits);
+  }
+  EXPECT_TRUE(events.empty());
+}
+
+TEST_P(PollerTest, HangUp) {
+  poller_->Add(fds_[0], POLLIN, &fds_[0]);
+  close(fds_[1]);
+  fds_[1] = -1;
+  EXPECT_TRUE(WaitFor(&fds_[0]) & POLLHUP);
+}
+
+TEST_P(PollerTest, InvalidDescriptor) {
+  int fd = dup(fds_[0]);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  poller_->Add(fd, POLLIN, &tag_);
+  EXPECT_EQ(POLLNVAL, WaitFor(&tag_));
+  poller_->Remove(fd);
+  EXPECT_EQ(-1, WaitFor(&tag_));
+}
+
+TEST_P(PollerTest, RegularFile) {
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file);
+  poller_->Add(fileno(file), POLLIN, &tag_);
+  EXPECT_EQ(POLLIN, WaitFor(&tag_));
+  poller_->Modify(fileno(file), POLLIN | POLLOUT, &tag_);
+  EXPECT_EQ(POLLIN | POLLOUT, WaitFor(&tag_));
+  poller_->Remove(fileno(file));
+  fclose(file);
+}
+
+TEST_P(PollerTest, Completions) {
+  if (!poller_->SupportsCompletions())
+    return;
+
+  // Returns the result reported for |data|, waiting up to a second for it.
+  // Completions reported meanwhile for other data are kept.
+  std::map<void*, int> results;
+  auto wait_for_result = [this, &results](void* data) {
+    for (int i = 0; i < 100 && !results.count(data); ++i) {
+      std::vector<Poller::Event> events;
+      EXPECT_TRUE(poller_->Wait(TimeDelta(10), &events));
+      for (const Poller::Event& event: events) {
+        if (!event.revents)
+          results[event.data] = event.result;
+      }
+    }
+    auto it = results.find(data);
+    if (it == results.end())
+      return -1;
+    int result = it->second;
+    results.erase(it);
+    return result;
+  };
+
+  uint8 out[3] = { 1, 2, 3 };
+  uint8 in[8] = { 0 };
+  poller_->Submit(Poller::READ, fds_[0], in, sizeof(in), &fds_[0]);
+  poller_->Submit(Poller::WRITE, fds_[1], out, sizeof(out), &fds_[1]);
+  EXPECT_EQ(3, wait_for_result(&fds_[1]));
+  EXPECT_EQ(3, wait_for_result(&fds_[0]));
+  EXPECT_EQ(3, in[2]);
+
+  // A read that can't complete.
+  poller_->Submit(Poller::READ, fds_[0], in, sizeof(in), &tag_);
+  EXPECT_EQ(-1, WaitFor(&tag_));
+  poller_->Cancel(&tag_);
+  EXPECT_EQ(-ECANCELED, wait_for_result(&tag_));
+
+  poller_->Submit(Poller::READ, -1, in, sizeof(in), &tag_);
+  EXPECT_EQ(-EBADF, wait_for_result(&tag_));
+}
+
+TEST_P(PollerTest, MoreRequestsThanTheRingHolds) {
+  // More than the io_uring submission ring holds, which is 256 entries.
+  const int kRequests = 300;
+
+  // Every duplicate of the write end is registered, and armed by the next
+  // Wait().
+  std::vector<int> fds(kRequests);
+  for (int i = 0; i < kRequests; ++i) {
+    fds[i] = dup(fds_[1]);
+    ASSERT_NE(-1, fds[i]);
+    poller_->Add(fds[i], POLLOUT, &fds[i]);
+  }
+  std::set<void*> ready;
+  std::vector<Poller::Event> events;
+  for (int i = 0; i < 100 && ready.size() < fds.size(); ++i) {
+    events.clear();
+    EXPECT_TRUE(poller_->Wait(TimeDelta(10), &events));
+    for (const Poller::Event& event: events)
+      ready.insert(event.data);
+  }
+  EXPECT_EQ(fds.size(), ready.size());
+  for (int fd: fds) {
+    poller_->Remove(fd);
+    close(fd);
+  }
+
+  if (!poller_->SupportsCompletions())
+    return;
+
+  // Submitted between two Wait()s.
+  uint8 byte = 0;
+  std::vector<int> tags(kRequests);
+  for (int i = 0; i < kRequests; ++i)
+    ASSERT_TRUE(poller_->Submit(Poller::WRITE, fds_[1], &byte, 1, &tags[i]));
+  int completed = 0;
+  for (int i = 0; i < 100 && completed < kRequests; ++i) {
+    events.clear();
+    EXPECT_TRUE(poller_->Wait(TimeDelta(10), &events));
+    for (const Poller::Event& event: events) {
+      if (!event.revents && event.result == 1)
+        completed++;
+    }
+  }
+  EXPECT_EQ(kRequests, completed);
+}
@@ -0,0 +1,144 @@
+#include "base/slab_allocator.h"
+
+#include <stdlib.h>
+
+namespace {
+
+const size_t kAlignment = 16;
+
+size_t align(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+uint64 tag_of(uint64 list) {
+  return list & ~(uint64) kuint32max;
+}
+
+uint32 index_of(uint64 list) {
+  return list & kuint32max;
+}
+
+}  // namespace
+
+// The header of each block. The object follows it.
+struct SlabAllocator::Block {
+  // The index of the next free block plus one, or zero. This is only
+  // meaningful while the block is free, but can be read by a thread that lost
+  // the race to pop it; hence the atomic.
+  std::atomic<uint32> next;
+  uint32 index;
+};
+
+const size_t SlabAllocator::kHeaderSize = align(sizeof(Block));
+
+SlabAllocator::SlabAllocator(size_t object_size)
+    : object_size_(object_size),
+      block_size_(align(kHeaderSize + object_size)),
+      free_list_(0),
+      slab_count_(0),
+      allocations_(0),
+      frees_(0) {
+  for (int i = 0; i < kMaxSlabs; ++i)
+    slabs_[i] = NULL;
+}
+
+SlabAllocator::~SlabAllocator() {
+  if (allocations_ != frees_)
+    DLOG(ERROR) << "Deleting SlabAllocator with live objects";
+  for (int i = 0; i < slab_count_; ++i)
+    free(slabs_[i]);
+}
+
+void* SlabAllocator::Allocate() {
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  uint64 list = free_list_.load();
+  for (;;) {
+    uint32 index = index_of(list);
+    if (!index)
+      return reinterpret_cast<char*>(Grow()) + kHeaderSize;
+    Block* block = BlockAt(index - 1);
+    // If another thread takes |block| first, |next| might be stale; but then
+    // the tag has changed and the exchange fails.
+    uint64 next = (tag_of(list) + (1ULL << 32)) |
+                  block->next.load(std::memory_order_relaxed);
+    if (free_list_.compare_exchange_weak(list, next))
+      return reinterpret_cast<char*>(block) + kHeaderSize;
+  }
+}
+
+void SlabAllocator::Free(void* object) {
+  frees_.fetch_add(1, std::memory_order_relaxed);
+  Block* block = reinterpret_cast<Block*>(
+      reinterpret_cast<char*>(object) - kHeaderSize);
+  PushList(block, block);
+}
+
+SlabAllocator::Stats SlabAllocator::stats() const {
+  Stats stats;
+  // An object is allocated before it's freed, so reading |frees_| first
+  // usually keeps |frees| <= |allocations|.
+  stats.frees = frees_.load();
+  stats.allocations = allocations_.load();
+  int slabs = slab_count_;
+  stats.slabs = slabs;
+  stats.slab_bytes =
+      (uint64) block_size_ * kFirstSlabBlocks * ((1ULL << slabs) - 1);
+  return stats;
+}
+
+SlabAllocator::Block* SlabAllocator::BlockAt(uint32 index) const {
+  // Slab k starts at block kFirstSlabBlocks * (2^k - 1).
+  uint32 n = index / kFirstSlabBlocks + 1;
+  int slab = 31 - __builtin_clz(n);
+  uint32 offset = index - kFirstSlabBlocks * ((1U << slab) - 1);
+  return reinterpret_cast<Block*>(slabs_[slab].load() + offset * block_size_);
+}
+
+SlabAllocator::Block* SlabAllocator::Grow() {
+  ScopedLock lock(grow_lock_);
+
+  // Another thread might have grown the allocator meanwhile.
+  uint64 list = free_list_.load();
+  while (index_of(list)) {
+    Block* block = BlockAt(index_of(list) - 1);
+    uint64 next = (tag_of(list) + (1ULL << 32)) |
+                  block->next.load(std::memory_order_relaxed);
+    if (free_list_.compare_exchange_weak(list, next))
+      return block;
+  }
+
+  int slab = slab_count_;
+  if (slab == kMaxSlabs)
+    LOG(FATAL) << "SlabAllocator is out of slabs";
+  uint32 count = kFirstSlabBlocks << slab;
+  uint32 first_index = kFirstSlabBlocks * ((1U << slab) - 1);
+  char* memory = static_cast<char*>(malloc(block_size_ * count));
+  if (!memory)
+    LOG(FATAL) << "malloc failed";
+
+  for (uint32 i = 0; i < count; ++i) {
+    Block* block = new (memory + i * block_size_) Block;
+    block->index = first_index + i;
+    // Link each block to the next one, in terms of |free_list_|.
+    block->next.store(i + 1 < count ? first_index + i + 2 : 0,
+                      std::memory_order_relaxed);
+  }
+  slabs_[slab] = memory;
+  slab_count_ = slab + 1;
+
+  Block* first = reinterpret_cast<Block*>(memory);
+  if (count > 1) {
+    PushList(reinterpret_cast<Block*>(memory + block_size_),
+             reinterpret_cast<Block*>(memory + (count - 1) * block_size_));
+  }
+  return first;
+}
+
+void SlabAllocator::PushList(Block* first, Block* last) {
+  uint64 list = free_list_.load();
+  uint64 next;
+  do {
+    last->next.store(index_of(list), std::memory_order_relaxed);
+    next = (tag_of(list) + (1ULL << 32)) | (first->index + 1);
+  } while (!free_list_.compare_exchange_weak(list, next));
+}
@@ -0,0 +1,95 @@
+#ifndef BASE_SLAB_ALLOCATOR_H
+#define BASE_SLAB_ALLOCATOR_H
+
+#include <atomic>
+#include <new>
+#include <utility>
+
+#include "base/base.h"
+#include "base/lock.h"
+#include "base/logging.h"
+
+// Allocates fixed size objects from slabs, and keeps the freed objects in a
+// lock-free list for reuse. Once the slabs are big enough for the peak number
+// of live objects, allocations don't call malloc anymore.
+//
+// Allocate() and Free() can be called from any thread. Slabs are only released
+// when the SlabAllocator is deleted.
+class SlabAllocator {
+ public:
+  struct Stats {
+    Stats() : allocations(0), frees(0), slabs(0), slab_bytes(0) {}
+
+    // Objects returned by Allocate(), and passed to Free().
+    uint64 allocations;
+    uint64 frees;
+    // Slabs obtained from malloc, and their total size.
+    uint64 slabs;
+    uint64 slab_bytes;
+  };
+
+  explicit SlabAllocator(size_t object_size);
+  ~SlabAllocator();
+
+  // Returns storage for an object of up to |object_size| bytes.
+  void* Allocate();
+
+  // Returns |object| to the allocator. |object| must come from Allocate().
+  void Free(void* object);
+
+  // Constructs a T in storage from Allocate().
+  template<typename T, typename... Args>
+  T* New(Args&&... args) {
+    DCHECK(sizeof(T) <= object_size_);
+    return new (Allocate()) T(std::forward<Args>(args)...);
+  }
+
+  // Destroys a T from New(), and frees its storage.
+  template<typename T>
+  void Delete(T* object) {
+    object->~T();
+    Free(object);
+  }
+
+  Stats stats() const;
+
+ private:
+  struct Block;
+
+  // Slab k holds kFirstSlabBlocks << k blocks.
+  static const int kMaxSlabs = 24;
+  static const uint32 kFirstSlabBlocks = 64;
+  // The size of a Block, aligned for the objects that follow it.
+  static const size_t kHeaderSize;
+
+  Block* BlockAt(uint32 index) const;
+
+  // Allocates a new slab and returns its first block. The other blocks go to
+  // the free list.
+  Block* Grow();
+
+  // Pushes the blocks from |first| to |last|, linked through their |next|
+  // member, to the free list.
+  void PushList(Block* first, Block* last);
+
+  const size_t object_size_;
+  const size_t block_size_;
+
+  // The index of the first free block plus one, or zero if the list is empty,
+  // in the low 32 bits. The high 32 bits are a tag that changes on every
+  // update, so that a block being popped can't be mistaken for a block that
+  // was popped and pushed again meanwhile.
+  std::atomic<uint64> free_list_;
+
+  std::atomic<char*> slabs_[kMaxSlabs];
+  // Only changes while holding |grow_lock_|.
+  std::atomic<int> slab_count_;
+  Lock grow_lock_;
+
+  std::atomic<uint64> allocations_;
+  std::atomic<uint64> frees_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+#endif  // BASE_SLAB_ALLOCATOR_H
@@ -0,0 +1,96 @@
+#include "base/slab_allocator.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/unittest.h"
+
+namespace {
+
+struct Object {
+  explicit Object(int value) : value(value) {}
+  ~Object() { value = -1; }
+
+  int value;
+  char padding[20];
+};
+
+void allocate_and_free(SlabAllocator* allocator, int id) {
+  std::vector<Object*> objects;
+  for (int round = 0; round < 100; ++round) {
+    for (int i = 0; i < 100; ++i)
+      objects.push_back(allocator->New<Object>(id * 1000000 + i));
+    for (int i = 0; i < 100; ++i) {
+      // Nobody else got the same object meanwhile.
+      ASSERT_EQ(id * 1000000 + i, objects[i]->value);
+      allocator->Delete(objects[i]);
+    }
+    objects.clear();
+  }
+}
+
+}  // namespace
+
+TEST(SlabAllocator, Reuse) {
+  SlabAllocator allocator(sizeof(Object));
+  SlabAllocator::Stats stats = allocator.stats();
+  EXPECT_EQ(0u, stats.allocations);
+  EXPECT_EQ(0u, stats.slabs);
+
+  Object* object = allocator.New<Object>(42);
+  EXPECT_EQ(42, object->value);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(object) % 16);
+  allocator.Delete(object);
+  EXPECT_EQ(object, allocator.New<Object>(43));
+  allocator.Delete(object);
+
+  stats = allocator.stats();
+  EXPECT_EQ(2u, stats.allocations);
+  EXPECT_EQ(2u, stats.frees);
+  EXPECT_EQ(1u, stats.slabs);
+  EXPECT_LT(0u, stats.slab_bytes);
+}
+
+TEST(SlabAllocator, Grow) {
+  SlabAllocator allocator(sizeof(Object));
+  std::vector<Object*> objects;
+  std::set<Object*> unique;
+  for (int i = 0; i < 1000; ++i) {
+    objects.push_back(allocator.New<Object>(i));
+    unique.insert(objects.back());
+  }
+  EXPECT_EQ(objects.size(), unique.size());
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(i, objects[i]->value);
+
+  // 64 + 128 + 256 + 512 + 1024 blocks.
+  uint64 slabs = allocator.stats().slabs;
+  EXPECT_EQ(5u, slabs);
+
+  // Freed objects are reused before growing again.
+  for (Object* object: objects)
+    allocator.Delete(object);
+  for (int i = 0; i < 1000; ++i)
+    objects[i] = allocator.New<Object>(i);
+  EXPECT_EQ(slabs, allocator.stats().slabs);
+  for (Object* object: objects)
+    allocator.Delete(object);
+}
+
+TEST(SlabAllocator, ManyThreads) {
+  const int kThreads = 8;
+  SlabAllocator allocator(sizeof(Object));
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.push_back(std::thread(Bind(allocate_and_free, &allocator, i)));
+  for (std::thread& t: threads)
+    t.join();
+
+  SlabAllocator::Stats stats = allocator.stats();
+  EXPECT_EQ(stats.allocations, stats.frees);
+  EXPECT_EQ(kThreads * 100u * 100u, stats.allocations);
+  // At most 800 objects were live at once.
+  EXPECT_GE(4u, stats.slabs);
+}
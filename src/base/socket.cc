@@ -114,6 +114,14 @@ unique_ptr<Socket> Socket::AcceptConnection() {
   return sock;
 }
 
+// static
+unique_ptr<Socket> Socket::AdoptConnection(int fd) {
+  DCHECK(fd >= 0);
+  unique_ptr<Socket> sock(new Socket(fd));
+  sock->is_server_ = false;
+  return sock;
+}
+
 // static
 unique_ptr<Socket> Socket::CreateSocket(const addrinfo& addr) {
   int fd = socket(addr.ai_family, addr.ai_socktype, addr.ai_protocol);
@@ -33,6 +33,10 @@ class Socket : public FileDescriptor {
   // new connection, NULL is returned instead.
   unique_ptr<Socket> AcceptConnection();
 
+  // Returns a Socket that owns |fd|, a connection accepted with
+  // EventLoop::PostAccept().
+  static unique_ptr<Socket> AdoptConnection(int fd);
+
  protected:
   explicit Socket(int fd) : FileDescriptor(fd) {}
 
@@ -0,0 +1,28 @@
+#include <string>
+#include <vector>
+
+#include "base/string_utils.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// Splits a line of |state.range(0)| comma separated fields, reusing the
+// vector like a parser looping over lines would.
+void BM_SplitString(benchmark::State& state) {
+  std::string line;
+  for (int i = 0; i < state.range(0); ++i) {
+    if (i)
+      line += ',';
+    line += "field" + std::to_string(i);
+  }
+  std::vector<std::string> fields;
+  for (auto _: state) {
+    SplitString(line, ',', &fields);
+    benchmark::DoNotOptimize(fields.data());
+  }
+  state.SetBytesProcessed(state.iterations() * line.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_SplitString)->Arg(4)->Arg(64);
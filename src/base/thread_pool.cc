@@ -0,0 +1,185 @@
+#include "base/thread_pool.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/logging.h"
+
+struct ThreadPool::Task {
+  explicit Task(Callback&& f)
+      : callback(std::forward<Callback>(f)),
+        reply_loop(NULL) {}
+
+  Task(Callback&& f, Callback&& reply)
+      : callback(std::forward<Callback>(f)),
+        reply_loop(EventLoop::Current()),
+        reply(std::forward<Callback>(reply)) {
+    DCHECK(reply_loop);
+  }
+
+  Callback callback;
+  EventLoop* reply_loop;
+  Callback reply;
+};
+
+struct ThreadPool::Worker {
+  Worker(ThreadPool* pool, uint32 seed) : pool(pool), random(seed) {}
+
+  ThreadPool* pool;
+  // Picks the first victim to steal from.
+  uint32 random;
+  WorkStealingDeque<Task> deque;
+};
+
+// static
+thread_local ThreadPool::Worker* ThreadPool::current_worker_ = NULL;
+
+ThreadPool::ThreadPool()
+    : task_allocator_(sizeof(Task)),
+      injected_size_(0),
+      epoch_(0),
+      quit_(false),
+      sleeping_(0) {}
+
+ThreadPool::~ThreadPool() {
+  {
+    ScopedLock lock(sleep_lock_);
+    quit_ = true;
+  }
+  wake_up_.notify_all();
+  for (std::thread& thread: threads_)
+    thread.join();
+}
+
+// static
+unique_ptr<ThreadPool> ThreadPool::Create(size_t size) {
+  if (!size)
+    size = std::max(1u, std::thread::hardware_concurrency());
+  unique_ptr<ThreadPool> pool(new ThreadPool);
+  for (size_t i = 0; i < size; ++i)
+    pool->workers_.push_back(make_unique(new Worker(pool.get(), i + 1)));
+  // Workers can steal from each other as soon as they start.
+  for (size_t i = 0; i < size; ++i) {
+    pool->threads_.push_back(std::thread(
+        Bind(&ThreadPool::RunWorker, pool.get(), pool->workers_[i].get())));
+  }
+  return pool;
+}
+
+void ThreadPool::Post(Callback&& f) {
+  Push(task_allocator_.New<Task>(std::forward<Callback>(f)));
+}
+
+void ThreadPool::PostAndReply(Callback&& f, Callback&& reply) {
+  Push(task_allocator_.New<Task>(std::forward<Callback>(f),
+                                 std::forward<Callback>(reply)));
+}
+
+bool ThreadPool::IsWorker() const {
+  return current_worker_ && current_worker_->pool == this;
+}
+
+void ThreadPool::Push(Task* task) {
+  Worker* worker = current_worker_;
+  if (worker && worker->pool == this) {
+    worker->deque.Push(task);
+  } else {
+    ScopedLock lock(injected_lock_);
+    injected_.push_back(task);
+    injected_size_++;
+  }
+
+  // Pairs with the fence in RunWorker(): either a worker about to sleep sees
+  // |task|, or |sleeping_| is seen here.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed) > 0) {
+    {
+      ScopedLock lock(sleep_lock_);
+      epoch_++;
+    }
+    wake_up_.notify_one();
+  }
+}
+
+ThreadPool::Task* ThreadPool::FindTask(Worker* worker) {
+  Task* task = worker->deque.Take();
+  if (task)
+    return task;
+
+  if (injected_size_ > 0) {
+    ScopedLock lock(injected_lock_);
+    if (!injected_.empty()) {
+      task = injected_.front();
+      injected_.pop_front();
+      injected_size_--;
+      return task;
+    }
+  }
+
+  // Steal from the others, starting at a random one. A steal can fail because
+  // another thief won the race; look again while that happens.
+  size_t count = workers_.size();
+  bool contended;
+  do {
+    contended = false;
+    worker->random = worker->random * 1103515245 + 12345;
+    size_t start = (worker->random >> 16) % count;
+    for (size_t i = 0; i < count; ++i) {
+      Worker* victim = workers_[(start + i) % count].get();
+      if (victim == worker)
+        continue;
+      task = victim->deque.Steal();
+      if (task)
+        return task;
+      contended = contended || !victim->deque.empty();
+    }
+  } while (contended);
+  return NULL;
+}
+
+void ThreadPool::RunWorker(Worker* worker) {
+  current_worker_ = worker;
+
+  for (;;) {
+    Task* task = FindTask(worker);
+    if (task) {
+      RunAndDelete(task);
+      continue;
+    }
+
+    uint64 epoch;
+    {
+      ScopedLock lock(sleep_lock_);
+      if (quit_)
+        break;
+      epoch = epoch_;
+    }
+
+    // Look once more after announcing the intent to sleep, so that a task
+    // pushed meanwhile isn't missed.
+    sleeping_++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    task = FindTask(worker);
+    if (task) {
+      sleeping_--;
+      RunAndDelete(task);
+      continue;
+    }
+    {
+      std::unique_lock<Lock> lock(sleep_lock_);
+      while (epoch_ == epoch && !quit_)
+        wake_up_.wait(lock);
+    }
+    sleeping_--;
+  }
+
+  current_worker_ = NULL;
+}
+
+void ThreadPool::RunAndDelete(Task* task) {
+  task->callback();
+  if (task->reply)
+    task->reply_loop->Post(std::move(task->reply));
+  task_allocator_.Delete(task);
+}
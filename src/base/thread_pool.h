@@ -0,0 +1,83 @@
+#ifndef BASE_THREAD_POOL_H
+#define BASE_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "base/base.h"
+#include "base/lock.h"
+#include "base/memory.h"
+#include "base/slab_allocator.h"
+#include "base/work_stealing_deque.h"
+
+class EventLoop;
+
+// Runs CPU bound tasks on a set of worker threads, unlike an EventLoop which
+// runs them one at a time.
+//
+// Each worker has its own deque. Tasks posted from a worker go to its deque,
+// and are run in LIFO order by that worker; idle workers steal the oldest
+// tasks of the others. Tasks posted from other threads go to a shared queue.
+// Workers without work sleep until more is posted.
+class ThreadPool {
+ public:
+  typedef std::function<void()> Callback;
+
+  // Returns a new pool with |size| workers, or one per CPU if |size| is zero.
+  static unique_ptr<ThreadPool> Create(size_t size = 0);
+
+  // Waits until all the posted tasks have run, including the ones they post.
+  ~ThreadPool();
+
+  size_t size() const { return workers_.size(); }
+
+  // Runs |f| on one of the workers. Can be called from any thread.
+  void Post(Callback&& f);
+
+  // Runs |f| on one of the workers, and then posts |reply| to the EventLoop
+  // that was running when PostAndReply() was invoked.
+  void PostAndReply(Callback&& f, Callback&& reply);
+
+  // Returns true if invoked on one of the workers of this pool.
+  bool IsWorker() const;
+
+ private:
+  struct Task;
+  struct Worker;
+
+  ThreadPool();
+
+  void Push(Task* task);
+  Task* FindTask(Worker* worker);
+  void RunWorker(Worker* worker);
+  void RunAndDelete(Task* task);
+
+  // The Worker running on the current thread, of any pool.
+  static thread_local Worker* current_worker_;
+
+  SlabAllocator task_allocator_;
+  std::vector<unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  // Tasks posted from other threads.
+  Lock injected_lock_;
+  std::deque<Task*> injected_;
+  std::atomic<size_t> injected_size_;
+
+  // Workers about to sleep increment |sleeping_| and then look for work once
+  // more; producers wake one up if it's not zero. |epoch_| changes whenever a
+  // worker is woken up.
+  Lock sleep_lock_;
+  std::condition_variable wake_up_;
+  uint64 epoch_;
+  bool quit_;
+  std::atomic<int> sleeping_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+#endif  // BASE_THREAD_POOL_H
@@ -0,0 +1,55 @@
+#include <atomic>
+#include <condition_variable>
+
+#include "base/bind.h"
+#include "base/lock.h"
+#include "base/thread_pool.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// Signals the benchmark thread once all the leaves have run.
+struct Join {
+  Join() : remaining(0), done(false) {}
+
+  std::atomic<int> remaining;
+  Lock lock;
+  std::condition_variable condition;
+  bool done;
+};
+
+// Splits into two tasks until |depth| is zero, like a parallel divide and
+// conquer algorithm with tiny leaves.
+void Fork(ThreadPool* pool, int depth, Join* join) {
+  if (depth) {
+    pool->Post(Bind(Fork, pool, depth - 1, join));
+    pool->Post(Bind(Fork, pool, depth - 1, join));
+    return;
+  }
+  if (--join->remaining == 0) {
+    ScopedLock lock(join->lock);
+    join->done = true;
+    join->condition.notify_one();
+  }
+}
+
+// Measures a fork/join of 2^16 tasks with |state.range(0)| workers.
+void BM_ForkJoin(benchmark::State& state) {
+  const int kDepth = 16;
+  unique_ptr<ThreadPool> pool = ThreadPool::Create(state.range(0));
+  Join join;
+  for (auto _: state) {
+    join.remaining = 1 << kDepth;
+    join.done = false;
+    pool->Post(Bind(Fork, pool.get(), kDepth, &join));
+    std::unique_lock<Lock> lock(join.lock);
+    while (!join.done)
+      join.condition.wait(lock);
+  }
+  // Every internal node and leaf is a task.
+  state.SetItemsProcessed(state.iterations() * ((2 << kDepth) - 1));
+}
+
+}  // namespace
+
+BENCHMARK(BM_ForkJoin)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
@@ -0,0 +1,80 @@
+#include "base/thread_pool.h"
+
+#include <atomic>
+#include <thread>
+
+#include "base/bind.h"
+#include "base/event_loop.h"
+#include "base/unittest.h"
+
+namespace {
+
+void increment_on_worker(ThreadPool* pool, std::atomic<int>* counter) {
+  EXPECT_TRUE(pool->IsWorker());
+  (*counter)++;
+}
+
+// Counts the leaves of a binary tree of tasks of the given |depth|.
+void fork_tasks(ThreadPool* pool, int depth, std::atomic<int>* leaves) {
+  if (!depth) {
+    (*leaves)++;
+    return;
+  }
+  pool->Post(Bind(fork_tasks, pool, depth - 1, leaves));
+  pool->Post(Bind(fork_tasks, pool, depth - 1, leaves));
+}
+
+void reply(EventLoop* loop, std::atomic<int>* counter, int* replies,
+           int expected) {
+  EXPECT_EQ(loop, EventLoop::Current());
+  // Each reply runs after its task.
+  EXPECT_LT(*replies, *counter);
+  if (++(*replies) == expected)
+    loop->QuitSoon();
+}
+
+void post_and_reply(ThreadPool* pool, std::atomic<int>* counter, int* replies,
+                    int expected) {
+  pool->PostAndReply(Bind(increment_on_worker, pool, counter),
+                     Bind(reply, EventLoop::Current(), counter, replies,
+                          expected));
+}
+
+}  // namespace
+
+TEST(ThreadPool, Post) {
+  std::atomic<int> counter(0);
+  unique_ptr<ThreadPool> pool = ThreadPool::Create(4);
+  ASSERT_TRUE(pool.get());
+  EXPECT_EQ(4u, pool->size());
+  EXPECT_FALSE(pool->IsWorker());
+  for (int i = 0; i < 1000; ++i)
+    pool->Post(Bind(increment_on_worker, pool.get(), &counter));
+  // Deleting the pool waits for the tasks.
+  pool.reset();
+  EXPECT_EQ(1000, counter);
+}
+
+TEST(ThreadPool, ForkJoin) {
+  std::atomic<int> leaves(0);
+  unique_ptr<ThreadPool> pool = ThreadPool::Create(4);
+  ASSERT_TRUE(pool.get());
+  pool->Post(Bind(fork_tasks, pool.get(), 14, &leaves));
+  pool.reset();
+  EXPECT_EQ(1 << 14, leaves);
+}
+
+TEST(ThreadPool, PostAndReply) {
+  const int kTasks = 100;
+  unique_ptr<EventLoop> loop = EventLoop::Create();
+  unique_ptr<ThreadPool> pool = ThreadPool::Create(2);
+  std::atomic<int> counter(0);
+  int replies = 0;
+
+  // The replies run on the loop that posted.
+  for (int i = 0; i < kTasks; ++i)
+    loop->Post(Bind(post_and_reply, pool.get(), &counter, &replies, kTasks));
+  loop->Run();
+  EXPECT_EQ(kTasks, counter);
+  EXPECT_EQ(kTasks, replies);
+}
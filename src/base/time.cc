@@ -1,5 +1,7 @@
 #include "base/time.h"
 
+#include <time.h>
+
 namespace {
 
 std::function<Time()> g_now;
@@ -17,3 +19,15 @@ Time Now() {
 void SetNowFunction(const std::function<Time()> now) {
   g_now = now;
 }
+
+uint64 MonotonicNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64 ThreadCpuNanos() {
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
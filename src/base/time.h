@@ -4,6 +4,8 @@
 #include <chrono>
 #include <functional>
 
+#include "base/base.h"
+
 #if !defined(__clang__) && defined(__GNUC__) && \
     (__GNUC__ < 4 || (__GNUC__ == 4 && __GNUC_MINOR__ < 7))
 #define steady_clock monotonic_clock
@@ -11,14 +13,28 @@
 
 typedef std::chrono::time_point<std::chrono::steady_clock> Time;
 typedef std::chrono::duration<int, std::milli> TimeDelta;
+// For delays finer than a millisecond. A TimeDelta converts to it implicitly.
+typedef std::chrono::duration<int64, std::micro> PreciseTimeDelta;
 
 template<typename Diff>
 inline TimeDelta ToTimeDelta(Diff d) {
   return std::chrono::duration_cast<TimeDelta>(d);
 }
 
+template<typename Diff>
+inline PreciseTimeDelta ToPreciseTimeDelta(Diff d) {
+  return std::chrono::duration_cast<PreciseTimeDelta>(d);
+}
+
 Time Now();
 
 void SetNowFunction(const std::function<Time()> now);
 
+// Returns nanoseconds since an arbitrary point, for measurements. Unlike Now()
+// this can't be overridden.
+uint64 MonotonicNanos();
+
+// Returns the CPU time used by the calling thread, in nanoseconds.
+uint64 ThreadCpuNanos();
+
 #endif  // BASE_TIME_H
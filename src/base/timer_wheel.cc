@@ -0,0 +1,182 @@
+#include "base/timer_wheel.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+TimerWheel::TimerWheel()
+    : now_(0),
+      size_(0) {
+  memset(occupied_, 0, sizeof(occupied_));
+  memset(slots_, 0, sizeof(slots_));
+}
+
+TimerWheel::~TimerWheel() {}
+
+void TimerWheel::Add(Timer* timer, uint64 expiry) {
+  DCHECK(!timer->is_scheduled());
+  timer->expiry_ = expiry;
+  Link(timer);
+  size_++;
+}
+
+void TimerWheel::Remove(Timer* timer) {
+  DCHECK(timer->is_scheduled());
+  Timer*& head = slots_[timer->slot_];
+  if (timer == head) {
+    head = timer->next_;
+    if (head)
+      head->prev_ = timer->prev_;
+    else
+      occupied_[timer->slot_ / kSlotsPerLevel] &=
+          ~(1ULL << (timer->slot_ % kSlotsPerLevel));
+  } else {
+    timer->prev_->next_ = timer->next_;
+    if (timer->next_)
+      timer->next_->prev_ = timer->prev_;
+    else
+      head->prev_ = timer->prev_;
+  }
+  timer->prev_ = NULL;
+  timer->next_ = NULL;
+  timer->slot_ = -1;
+  size_--;
+}
+
+void TimerWheel::RemoveAll(std::vector<Timer*>* removed) {
+  for (int index = 0; index < kLevels * kSlotsPerLevel; ++index) {
+    Timer* timer = slots_[index];
+    slots_[index] = NULL;
+    while (timer) {
+      Timer* next = timer->next_;
+      timer->prev_ = NULL;
+      timer->next_ = NULL;
+      timer->slot_ = -1;
+      removed->push_back(timer);
+      timer = next;
+    }
+  }
+  memset(occupied_, 0, sizeof(occupied_));
+  size_ = 0;
+}
+
+void TimerWheel::Advance(uint64 now, std::vector<Timer*>* expired) {
+  for (;;) {
+    int slots[kLevels];
+    uint64 next = kuint64max;
+    for (int level = 0; level < kLevels; ++level) {
+      slots[level] = NextSlot(level);
+      if (slots[level] != -1)
+        next = std::min(next, SlotStart(level, slots[level]));
+    }
+    if (next > now)
+      break;
+
+    // Process the slots starting at |next|. No slot starts before it, so
+    // jumping there keeps every other timer in a valid slot.
+    for (int level = 0; level < kLevels; ++level) {
+      if (slots[level] == -1 || SlotStart(level, slots[level]) != next)
+        slots[level] = -1;
+    }
+    now_ = next;
+    for (int level = 0; level < kLevels; ++level) {
+      int slot = slots[level];
+      if (slot == -1)
+        continue;
+      Timer* timer = slots_[level * kSlotsPerLevel + slot];
+      slots_[level * kSlotsPerLevel + slot] = NULL;
+      occupied_[level] &= ~(1ULL << slot);
+      while (timer) {
+        Timer* next_timer = timer->next_;
+        timer->prev_ = NULL;
+        timer->next_ = NULL;
+        timer->slot_ = -1;
+        if (level == 0) {
+          size_--;
+          expired->push_back(timer);
+        } else {
+          // Cascade to a finer level.
+          Link(timer);
+        }
+        timer = next_timer;
+      }
+    }
+  }
+  if (now > now_)
+    now_ = now;
+}
+
+uint64 TimerWheel::NextExpiry() const {
+  uint64 next = kuint64max;
+  for (int level = 0; level < kLevels; ++level) {
+    int slot = NextSlot(level);
+    if (slot != -1) {
+      uint64 start = SlotStart(level, slot);
+      if (start < next)
+        next = start;
+    }
+  }
+  return next;
+}
+
+uint64 TimerWheel::SlotStart(int level, int slot) const {
+  int shift = kBitsPerLevel * level;
+  int window_shift = shift + kBitsPerLevel;
+  uint64 start = ((now_ >> window_shift) << window_shift) +
+                 ((uint64) slot << shift);
+  // Slots behind the current one belong to the next turn of the level.
+  if (level == 0 ? start < now_ : start <= now_)
+    start += 1ULL << window_shift;
+  return start;
+}
+
+int TimerWheel::NextSlot(int level) const {
+  uint64 bits = occupied_[level];
+  if (!bits)
+    return -1;
+  int current = (now_ >> (kBitsPerLevel * level)) & (kSlotsPerLevel - 1);
+  // The current slot of the coarser levels has already been cascaded.
+  int first = level == 0 ? current : (current + 1) & (kSlotsPerLevel - 1);
+  uint64 rotated = first ? (bits >> first) | (bits << (64 - first)) : bits;
+  return (first + __builtin_ctzll(rotated)) & (kSlotsPerLevel - 1);
+}
+
+void TimerWheel::Link(Timer* timer) {
+  uint64 expiry = timer->expiry_ < now_ ? now_ : timer->expiry_;
+  uint64 diff = expiry ^ now_;
+
+  // The level is the first one whose current window contains |expiry|.
+  int level = 0;
+  while (level < kLevels - 1 && (diff >> (kBitsPerLevel * (level + 1))))
+    level++;
+
+  // The top level wraps around, and can hold any expiry up to a full turn
+  // ahead.
+  int slot;
+  if ((expiry - now_) >> (kBitsPerLevel * kLevels)) {
+    // Beyond the range of the wheel. Park it in the last slot of the top
+    // level, which cascades it again after almost a full turn.
+    slot = ((now_ >> (kBitsPerLevel * level)) + kSlotsPerLevel - 1) &
+           (kSlotsPerLevel - 1);
+  } else {
+    slot = (expiry >> (kBitsPerLevel * level)) & (kSlotsPerLevel - 1);
+  }
+
+  // Append to the slot, so that timers expiring at the same tick expire in
+  // the order they were added. The head's |prev_| points to the tail.
+  int index = level * kSlotsPerLevel + slot;
+  Timer*& head = slots_[index];
+  timer->next_ = NULL;
+  if (head) {
+    timer->prev_ = head->prev_;
+    head->prev_->next_ = timer;
+    head->prev_ = timer;
+  } else {
+    timer->prev_ = timer;
+    head = timer;
+  }
+  occupied_[level] |= 1ULL << slot;
+  timer->slot_ = index;
+}
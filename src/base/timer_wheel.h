@@ -0,0 +1,93 @@
+#ifndef BASE_TIMER_WHEEL_H
+#define BASE_TIMER_WHEEL_H
+
+#include <vector>
+
+#include "base/base.h"
+
+// A hierarchical timing wheel. Timers expire at a given tick; the unit of the
+// ticks is up to the user.
+//
+// Add() and Remove() are O(1). Timers far in the future start in the coarser
+// levels of the wheel and cascade down as the wheel advances, which costs at
+// most one move per level. Advance() skips empty slots, so large jumps in time
+// are cheap too.
+//
+// TimerWheels are not thread safe.
+class TimerWheel {
+ public:
+  // Base class for the entries of the wheel. The wheel doesn't own them.
+  class Timer {
+   public:
+    Timer() : prev_(NULL), next_(NULL), expiry_(0), slot_(-1) {}
+
+    uint64 expiry() const { return expiry_; }
+
+    // Returns true while the Timer is in a wheel.
+    bool is_scheduled() const { return slot_ >= 0; }
+
+   private:
+    friend class TimerWheel;
+
+    Timer* prev_;
+    Timer* next_;
+    uint64 expiry_;
+    int slot_;
+
+    DISALLOW_COPY_AND_ASSIGN(Timer);
+  };
+
+  TimerWheel();
+  ~TimerWheel();
+
+  // The tick that the wheel has advanced to.
+  uint64 now() const { return now_; }
+
+  // The number of timers in the wheel.
+  size_t size() const { return size_; }
+
+  // Adds |timer| to expire at |expiry|. Expiries before now() expire on the
+  // next Advance().
+  void Add(Timer* timer, uint64 expiry);
+
+  // Removes a scheduled |timer| from the wheel.
+  void Remove(Timer* timer);
+
+  // Removes every timer from the wheel, and appends them to |removed| in no
+  // particular order.
+  void RemoveAll(std::vector<Timer*>* removed);
+
+  // Advances the wheel to |now|, and appends the timers expiring at or before
+  // |now| to |expired| in expiry order. These timers are removed from the
+  // wheel. Moving the wheel backwards does nothing.
+  void Advance(uint64 now, std::vector<Timer*>* expired);
+
+  // Returns a lower bound for the next expiry, or kuint64max if the wheel is
+  // empty. Advancing to this tick either expires a timer or moves some closer
+  // to expiration.
+  uint64 NextExpiry() const;
+
+ private:
+  static const int kBitsPerLevel = 6;
+  static const int kSlotsPerLevel = 1 << kBitsPerLevel;
+  static const int kLevels = 6;
+
+  // Returns the tick when |slot| of |level| has to be processed.
+  uint64 SlotStart(int level, int slot) const;
+
+  // Returns the slot of |level| with the earliest start, or -1 if |level| is
+  // empty.
+  int NextSlot(int level) const;
+
+  void Link(Timer* timer);
+
+  uint64 now_;
+  size_t size_;
+  // One bit per non-empty slot, for each level.
+  uint64 occupied_[kLevels];
+  Timer* slots_[kLevels * kSlotsPerLevel];
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheel);
+};
+
+#endif  // BASE_TIMER_WHEEL_H
@@ -0,0 +1,191 @@
+#include "base/timer_wheel.h"
+
+#include <algorithm>
+#include <random>
+
+#include "base/unittest.h"
+
+namespace {
+
+struct TestTimer : public TimerWheel::Timer {
+  TestTimer() : id(0) {}
+  int id;
+};
+
+// Advances |wheel| to |now| and returns the ids of the expired timers.
+std::vector<int> AdvanceTo(TimerWheel* wheel, uint64 now) {
+  std::vector<TimerWheel::Timer*> expired;
+  wheel->Advance(now, &expired);
+  std::vector<int> ids;
+  for (TimerWheel::Timer* timer: expired) {
+    EXPECT_FALSE(timer->is_scheduled());
+    ids.push_back(static_cast<TestTimer*>(timer)->id);
+  }
+  return ids;
+}
+
+std::vector<int> Ids(int a) { return std::vector<int>(1, a); }
+
+std::vector<int> Ids(int a, int b) {
+  std::vector<int> v(1, a);
+  v.push_back(b);
+  return v;
+}
+
+}  // namespace
+
+TEST(TimerWheel, Expire) {
+  TimerWheel wheel;
+  TestTimer timers[4];
+  for (int i = 0; i < 4; ++i)
+    timers[i].id = i;
+
+  EXPECT_EQ(kuint64max, wheel.NextExpiry());
+  wheel.Add(&timers[0], 30);
+  wheel.Add(&timers[1], 10);
+  wheel.Add(&timers[2], 10);
+  wheel.Add(&timers[3], 5000);
+  EXPECT_EQ(4u, wheel.size());
+  EXPECT_TRUE(timers[0].is_scheduled());
+  EXPECT_EQ(10u, wheel.NextExpiry());
+
+  EXPECT_TRUE(AdvanceTo(&wheel, 9).empty());
+  EXPECT_EQ(9u, wheel.now());
+  // Same expiry: in the order they were added.
+  EXPECT_EQ(Ids(1, 2), AdvanceTo(&wheel, 25));
+  EXPECT_EQ(Ids(0), AdvanceTo(&wheel, 30));
+  EXPECT_EQ(1u, wheel.size());
+  EXPECT_LE(wheel.NextExpiry(), 5000u);
+  EXPECT_TRUE(AdvanceTo(&wheel, 4999).empty());
+  EXPECT_EQ(Ids(3), AdvanceTo(&wheel, 1000000));
+  EXPECT_EQ(0u, wheel.size());
+  EXPECT_EQ(1000000u, wheel.now());
+
+  // Expiries in the past expire on the next Advance().
+  wheel.Add(&timers[0], 10);
+  EXPECT_EQ(wheel.now(), wheel.NextExpiry());
+  EXPECT_EQ(Ids(0), AdvanceTo(&wheel, wheel.now()));
+
+  // Moving backwards does nothing.
+  wheel.Add(&timers[1], 1000010);
+  EXPECT_TRUE(AdvanceTo(&wheel, 5).empty());
+  EXPECT_EQ(1000000u, wheel.now());
+  EXPECT_EQ(Ids(1), AdvanceTo(&wheel, 1000010));
+}
+
+TEST(TimerWheel, Remove) {
+  TimerWheel wheel;
+  TestTimer timers[3];
+  for (int i = 0; i < 3; ++i) {
+    timers[i].id = i;
+    wheel.Add(&timers[i], 100);
+  }
+  wheel.Remove(&timers[1]);
+  EXPECT_FALSE(timers[1].is_scheduled());
+  wheel.Remove(&timers[0]);
+  wheel.Remove(&timers[2]);
+  EXPECT_EQ(0u, wheel.size());
+  EXPECT_EQ(kuint64max, wheel.NextExpiry());
+  EXPECT_TRUE(AdvanceTo(&wheel, 200).empty());
+
+  wheel.Add(&timers[1], 300);
+  wheel.Add(&timers[2], 300);
+  wheel.Remove(&timers[2]);
+  EXPECT_EQ(Ids(1), AdvanceTo(&wheel, 300));
+}
+
+TEST(TimerWheel, RemoveAll) {
+  TimerWheel wheel;
+  TestTimer timers[3];
+  wheel.Add(&timers[0], 10);
+  wheel.Add(&timers[1], 10);
+  wheel.Add(&timers[2], 1ULL << 50);
+  std::vector<TimerWheel::Timer*> removed;
+  wheel.RemoveAll(&removed);
+  EXPECT_EQ(3u, removed.size());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FALSE(timers[i].is_scheduled());
+    EXPECT_EQ(1, std::count(removed.begin(), removed.end(), &timers[i]));
+  }
+  EXPECT_EQ(0u, wheel.size());
+  EXPECT_EQ(kuint64max, wheel.NextExpiry());
+  EXPECT_TRUE(AdvanceTo(&wheel, 1ULL << 51).empty());
+
+  wheel.Add(&timers[1], wheel.now() + 5);
+  EXPECT_EQ(Ids(0), AdvanceTo(&wheel, wheel.now() + 5));
+}
+
+TEST(TimerWheel, FarFuture) {
+  TimerWheel wheel;
+  TestTimer timer;
+  timer.id = 7;
+  // Beyond the range of the wheel.
+  const uint64 kFar = 1ULL << 50;
+  wheel.Add(&timer, kFar);
+  EXPECT_LT(wheel.NextExpiry(), kFar);
+  EXPECT_TRUE(AdvanceTo(&wheel, kFar - 1).empty());
+  EXPECT_EQ(kFar, wheel.NextExpiry());
+  EXPECT_EQ(Ids(7), AdvanceTo(&wheel, kFar));
+
+  // Close, but across the boundary of a turn of the top level.
+  const uint64 kTurn = kFar + (3ULL << 36);
+  EXPECT_TRUE(AdvanceTo(&wheel, kTurn - 10).empty());
+  wheel.Add(&timer, kTurn + 5);
+  EXPECT_LE(wheel.NextExpiry(), kTurn + 5);
+  EXPECT_TRUE(AdvanceTo(&wheel, kTurn + 4).empty());
+  EXPECT_EQ(Ids(7), AdvanceTo(&wheel, kTurn + 5));
+}
+
+// Compares the wheel with a sorted reference, with random expiries, removals
+// and advances.
+TEST(TimerWheel, Random) {
+  const int kTimers = 2000;
+  std::mt19937 random(42);
+  TimerWheel wheel;
+  std::vector<TestTimer> timers(kTimers);
+  uint64 now = 0;
+
+  for (int round = 0; round < 50; ++round) {
+    for (int i = 0; i < kTimers; ++i) {
+      timers[i].id = i;
+      if (!timers[i].is_scheduled() && random() % 2) {
+        // Mix short and long delays.
+        uint64 delay = random() % (1 << (random() % 30));
+        wheel.Add(&timers[i], now + delay);
+      } else if (timers[i].is_scheduled() && random() % 8 == 0) {
+        wheel.Remove(&timers[i]);
+      }
+    }
+
+    now += random() % (1 << (random() % 24));
+    std::vector<int> expected;
+    for (int i = 0; i < kTimers; ++i) {
+      if (timers[i].is_scheduled() && timers[i].expiry() <= now)
+        expected.push_back(i);
+    }
+
+    std::vector<TimerWheel::Timer*> expired;
+    wheel.Advance(now, &expired);
+    std::vector<int> ids;
+    uint64 last_expiry = 0;
+    for (TimerWheel::Timer* timer: expired) {
+      EXPECT_LE(last_expiry, timer->expiry());
+      last_expiry = timer->expiry();
+      ids.push_back(static_cast<TestTimer*>(timer)->id);
+    }
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(expected, ids);
+
+    size_t scheduled = 0;
+    uint64 earliest = kuint64max;
+    for (int i = 0; i < kTimers; ++i) {
+      if (timers[i].is_scheduled()) {
+        scheduled++;
+        earliest = std::min(earliest, timers[i].expiry());
+      }
+    }
+    EXPECT_EQ(scheduled, wheel.size());
+    EXPECT_LE(wheel.NextExpiry(), earliest);
+    EXPECT_GT(wheel.NextExpiry(), now);
+  }
+}
@@ -1,9 +1,60 @@
 #include "base/unittest.h"
 
+#include <stdlib.h>
+
 #include "base/event_loop.h"
 #include "base/logging.h"
 #include "base/socket.h"
 
+std::vector<Poller::Backend> AvailablePollerBackends() {
+  std::vector<Poller::Backend> backends;
+  for (Poller::Backend backend: { Poller::POLL, Poller::EPOLL,
+                                  Poller::IO_URING }) {
+    if (Poller::Create(backend))
+      backends.push_back(backend);
+  }
+  return backends;
+}
+
+namespace {
+
+thread_local size_t g_heap_allocations = 0;
+
+}  // namespace
+
+// Replaces the global allocation functions to count them. All the forms that
+// free memory are replaced too, since C++14 calls the sized ones.
+void* operator new(size_t size) {
+  g_heap_allocations++;
+  void* ptr = malloc(size ? size : 1);
+  CHECK(ptr);
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t size) noexcept {
+  free(ptr);
+}
+
+size_t ThreadHeapAllocations() {
+  return g_heap_allocations;
+}
+
 BaseTest::BaseTest()
     : running_(false) {}
 
@@ -12,7 +63,8 @@ BaseTest::~BaseTest() {}
 void BaseTest::SetUp() {
   loop_ = EventLoop::Create();
   CHECK(loop_);
-  dns_ = DNS::Create();
+  blocking_pool_ = BlockingPool::Create();
+  dns_ = DNS::Create(blocking_pool_.get());
   CHECK(dns_);
   EventLoop::SetCurrent(loop_.get());
 }
@@ -20,6 +72,7 @@ void BaseTest::SetUp() {
 void BaseTest::TearDown() {
   RunAllPending();
   dns_.reset();
+  blocking_pool_.reset();
   loop_.reset();
   EventLoop::SetCurrent(NULL);
 }
@@ -27,15 +80,18 @@ void BaseTest::TearDown() {
 void BaseTest::RunAllPending() {
   EventLoop::SetCurrent(NULL);
 
-  // Post a task to
-  // tell the DNS look to post a task to
-  // quit the main loop. This ensures that once the main loop quits, all the
-  // pending tasks on DNS have been processed.
-  auto postquit = Bind(&EventLoop::QuitSoon, loop_.get());
-  auto postpostquit = Bind(&EventLoop::Post, dns_->loop(),
-                           std::move(postquit));
-  loop_->Post(std::move(postpostquit));
-  loop_->Run();
+  // The blocking tasks post their replies before they are done, so these
+  // are all pending on the main loop once the pool is idle. Running them can
+  // post more blocking tasks; repeat until a pass doesn't.
+  for (;;) {
+    blocking_pool_->WaitUntilIdle();
+    uint64 completed = blocking_pool_->stats().completed;
+    loop_->QuitSoon();
+    loop_->Run();
+    blocking_pool_->WaitUntilIdle();
+    if (blocking_pool_->stats().completed == completed)
+      break;
+  }
 
   EventLoop::SetCurrent(loop_.get());
 }
@@ -119,6 +175,24 @@ void BaseTest::OnTimeout() {
   }
 }
 
+TwoLoopTest::TwoLoopTest() {}
+
+TwoLoopTest::~TwoLoopTest() {}
+
+void TwoLoopTest::SetUp() {
+  BaseTest::SetUp();
+  other_ = EventLoop::Create();
+  CHECK(other_);
+  thread_ = std::thread(Bind(&EventLoop::Run, other_.get()));
+}
+
+void TwoLoopTest::TearDown() {
+  other_->QuitSoon();
+  thread_.join();
+  BaseTest::TearDown();
+  other_.reset();
+}
+
 int main(int argc, char *argv[]) {
   testing::InitGoogleTest(&argc, argv);
   int ret = RUN_ALL_TESTS();
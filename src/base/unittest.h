@@ -12,14 +12,27 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <thread>
+#include <vector>
+
 #include "base/base.h"
+#include "base/blocking_pool.h"
 #include "base/dns.h"
 #include "base/memory.h"
+#include "base/poller.h"
 #include "base/time.h"
 
 class EventLoop;
 class Socket;
 
+// Returns the Poller backends that can be created on this machine, to run
+// parameterized tests with each of them.
+std::vector<Poller::Backend> AvailablePollerBackends();
+
+// Returns how many times the global operator new has been invoked on the
+// current thread, to check that some code doesn't allocate.
+size_t ThreadHeapAllocations();
+
 // A base class for tests that need an EventLoop. The TestBody runs within
 // the |loop_|.
 class BaseTest : public testing::Test {
@@ -51,6 +64,7 @@ class BaseTest : public testing::Test {
 
  protected:
   unique_ptr<EventLoop> loop_;
+  unique_ptr<BlockingPool> blocking_pool_;
   unique_ptr<DNS> dns_;
 
  private:
@@ -68,4 +82,25 @@ class BaseTest : public testing::Test {
   DISALLOW_COPY_AND_ASSIGN(BaseTest);
 };
 
+// A BaseTest that also runs |other_| on its own thread, for tests that hop
+// between loops.
+class TwoLoopTest : public BaseTest {
+ protected:
+  TwoLoopTest();
+
+ public:
+  virtual ~TwoLoopTest();
+
+  virtual void SetUp() override;
+  virtual void TearDown() override;
+
+ protected:
+  unique_ptr<EventLoop> other_;
+
+ private:
+  std::thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(TwoLoopTest);
+};
+
 #endif  // BASE_UNITTEST_H
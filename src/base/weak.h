@@ -1,8 +1,9 @@
 #ifndef BASE_WEAK_H
 #define BASE_WEAK_H
 
+#include <atomic>
+
 #include "base/base.h"
-#include "base/lock.h"
 #include "base/logging.h"
 #include "base/memory.h"
 #include "base/thread_checker.h"
@@ -27,8 +28,7 @@ class WeakFlag {
 
   WeakFlag(const WeakFlag& other)
       : shared_(other.shared_) {
-    ScopedLock lock(shared_->lock);
-    shared_->ref_count++;
+    shared_->Ref();
   }
 
   ~WeakFlag() {
@@ -37,20 +37,16 @@ class WeakFlag {
 
   WeakFlag& operator=(const WeakFlag& other) {
     // |other| might be |this|; bump the |ref_count| first.
-    {
-      ScopedLock lock(other.shared_->lock);
-      other.shared_->ref_count++;
-    }
+    other.shared_->Ref();
     Unref(other.shared_);
     return *this;
   }
 
   bool IsValid() const {
-    ScopedLock lock(shared_->lock);
 #if !defined(NDEBUG)
     DCHECK(shared_->checker.Check());
 #endif
-    return shared_->valid;
+    return shared_->valid.load(std::memory_order_relaxed);
   }
 
   explicit operator bool() const { return IsValid(); }
@@ -58,20 +54,19 @@ class WeakFlag {
   // Returns true if there's at least another WeakFlag sharing the validation
   // flag with this WeakFlag.
   bool IsSharing() const {
-    ScopedLock lock(shared_->lock);
 #if !defined(NDEBUG)
     DCHECK(shared_->checker.Check());
 #endif
-    return shared_->valid && shared_->ref_count > 1;
+    return shared_->valid.load(std::memory_order_relaxed) &&
+           shared_->ref_count.load(std::memory_order_acquire) > 1;
   }
 
   // Invalidates all WeakFlags shared with this.
   void InvalidateAll() {
-    ScopedLock lock(shared_->lock);
 #if !defined(NDEBUG)
     DCHECK(shared_->checker.Check());
 #endif
-    shared_->valid = false;
+    shared_->valid.store(false, std::memory_order_relaxed);
   }
 
   // Invalidates only this WeakFlag, but not the other WeakFlags sharing the
@@ -83,29 +78,37 @@ class WeakFlag {
  private:
   // |Shared| is the shared state. A WeakFlag always has a pointer to such a
   // struct. Copies of a WeakFlag bump the |ref_count|, and decrease it when
-  // destroyed. The last copy releases the struct. Access to this struct must
-  // own |lock|.
+  // destroyed. The last copy releases the struct.
+  //
+  // |valid| is only tested and changed on the owning thread, so it needs no
+  // ordering; it's atomic so that testing it on the wrong thread in release
+  // builds is a stale read rather than undefined behavior. The |ref_count| is
+  // updated from any thread, like a shared_ptr's.
   struct Shared {
     explicit Shared(bool is_valid) : ref_count(1), valid(is_valid) {}
+
+    void Ref() {
+      ref_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Returns true when the last reference is gone. Whoever deletes the
+    // struct sees all the changes of the other owners.
+    bool Unref() {
+      return ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
 #if !defined(NDEBUG)
     ThreadChecker checker;
 #endif
-    Lock lock;
-    int ref_count;
-    bool valid;
+    std::atomic<int> ref_count;
+    std::atomic<bool> valid;
   };
 
   void Unref(Shared* new_shared) {
-    Shared* destroy_shared = NULL;
-    {
-      ScopedLock lock(shared_->lock);
-      shared_->ref_count--;
-      if (shared_->ref_count == 0)
-        destroy_shared = shared_;
-      shared_ = new_shared;
-    }
-    if (destroy_shared)
-      delete destroy_shared;
+    Shared* old_shared = shared_;
+    shared_ = new_shared;
+    if (old_shared->Unref())
+      delete old_shared;
   }
 
   Shared* shared_;
@@ -0,0 +1,67 @@
+#include "base/bind.h"
+#include "base/weak.h"
+#include "benchmark/benchmark.h"
+
+namespace {
+
+class Target {
+ public:
+  Target() : calls_(0) {}
+
+  void Call() { calls_++; }
+
+  int calls() const { return calls_; }
+
+ private:
+  int calls_;
+};
+
+// Copies a WeakPtr and drops the copy, like binding it to a task does. With
+// more than one thread they all copy the same WeakPtr.
+void BM_CopyWeakPtr(benchmark::State& state) {
+  static Target* target;
+  static ScopedWeakPtrFactory<Target>* factory;
+  static WeakPtr<Target>* weak;
+  if (state.thread_index() == 0) {
+    target = new Target;
+    factory = new ScopedWeakPtrFactory<Target>(target);
+    weak = new WeakPtr<Target>(factory->GetWeakPtr());
+  }
+  for (auto _: state) {
+    WeakPtr<Target> copy(*weak);
+    benchmark::DoNotOptimize(&copy);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete weak;
+    delete factory;
+    delete target;
+  }
+}
+
+// Checks whether a WeakPtr is still valid, on its owning thread.
+void BM_CheckWeakPtr(benchmark::State& state) {
+  Target target;
+  ScopedWeakPtrFactory<Target> factory(&target);
+  WeakPtr<Target> weak = factory.GetWeakPtr();
+  for (auto _: state)
+    benchmark::DoNotOptimize(weak.get());
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Invokes a method bound to a WeakPtr, which checks it first.
+void BM_InvokeWeakMethod(benchmark::State& state) {
+  Target target;
+  ScopedWeakPtrFactory<Target> factory(&target);
+  auto callback = Bind(&Target::Call, factory.GetWeakPtr());
+  for (auto _: state)
+    callback();
+  benchmark::DoNotOptimize(target.calls());
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+BENCHMARK(BM_CopyWeakPtr)->ThreadRange(1, 4);
+BENCHMARK(BM_CheckWeakPtr);
+BENCHMARK(BM_InvokeWeakMethod);
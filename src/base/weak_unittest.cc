@@ -124,9 +124,10 @@ TEST(Weak, CopyAcrossThreads) {
   auto invalidate = Bind(&WeakIncrementer::InvalidateAll,
                          incrementer2->GetWeakPtr());
 
-  other->Post(Bind(&EventLoop::Post, main.get(), inc));
-  other->Post(Bind(&EventLoop::Post, main.get(), invalidate));
-  other->Post(Bind(&EventLoop::Post, main.get(), inc2));
+  other->Post(Bind(&EventLoop::Post, main.get(), inc, EventLoop::NORMAL));
+  other->Post(Bind(&EventLoop::Post, main.get(), invalidate,
+                   EventLoop::NORMAL));
+  other->Post(Bind(&EventLoop::Post, main.get(), inc2, EventLoop::NORMAL));
   other->Post(Bind(&EventLoop::QuitSoon, main.get()));
   other->QuitSoon();
 
@@ -0,0 +1,132 @@
+#ifndef BASE_WORK_STEALING_DEQUE_H
+#define BASE_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <vector>
+
+#include "base/base.h"
+
+// A Chase-Lev deque of pointers. The owner thread pushes and takes at the
+// bottom without contention, while any other thread can steal from the top.
+// This follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+// by Lê, Pop, Cohen and Zappa Nardelli.
+//
+// The deque grows as needed. Old arrays are kept until the deque is deleted,
+// since a thief might still be reading from them.
+template<typename T>
+class WorkStealingDeque {
+ public:
+  WorkStealingDeque()
+      : top_(0), bottom_(0), array_(new Array(kInitialSize)) {
+    arrays_.push_back(array_.load());
+  }
+
+  ~WorkStealingDeque() {
+    for (Array* array: arrays_)
+      delete array;
+  }
+
+  // Pushes |item| at the bottom. Must only be called by the owner.
+  void Push(T* item) {
+    int64 bottom = bottom_.load(std::memory_order_relaxed);
+    int64 top = top_.load(std::memory_order_acquire);
+    Array* array = array_.load(std::memory_order_relaxed);
+    if (bottom - top >= array->size)
+      array = Grow(array, top, bottom);
+    array->Put(bottom, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  // Takes the item at the bottom, which is the last one pushed, or returns
+  // NULL if the deque is empty. Must only be called by the owner.
+  T* Take() {
+    int64 bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* array = array_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      // Empty.
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return NULL;
+    }
+    T* item = array->Get(bottom);
+    if (top == bottom) {
+      // The last item; race the thieves for it.
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = NULL;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Takes the item at the top, which is the oldest one, or returns NULL if
+  // the deque is empty or another thread got it first. Can be called from any
+  // thread.
+  T* Steal() {
+    int64 top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom)
+      return NULL;
+    Array* array = array_.load(std::memory_order_acquire);
+    T* item = array->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return NULL;
+    }
+    return item;
+  }
+
+  // This is racy, unless called by the owner while there are no thieves.
+  bool empty() const {
+    return bottom_.load() <= top_.load();
+  }
+
+ private:
+  static const int64 kInitialSize = 256;
+
+  struct Array {
+    explicit Array(int64 size)
+        : size(size), items(new std::atomic<T*>[size]) {}
+    ~Array() { delete[] items; }
+
+    T* Get(int64 index) const {
+      return items[index & (size - 1)].load(std::memory_order_relaxed);
+    }
+
+    void Put(int64 index, T* item) {
+      items[index & (size - 1)].store(item, std::memory_order_relaxed);
+    }
+
+    const int64 size;
+    std::atomic<T*>* items;
+  };
+
+  Array* Grow(Array* array, int64 top, int64 bottom) {
+    Array* grown = new Array(array->size * 2);
+    for (int64 i = top; i < bottom; ++i)
+      grown->Put(i, array->Get(i));
+    arrays_.push_back(grown);
+    array_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  // Thieves write |top_| and the owner writes |bottom_|; keep them on separate
+  // cache lines.
+  std::atomic<int64> top_;
+  char padding_[64 - sizeof(std::atomic<int64>)];
+  std::atomic<int64> bottom_;
+  std::atomic<Array*> array_;
+  // Every array ever used, owned by the deque.
+  std::vector<Array*> arrays_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingDeque);
+};
+
+#endif  // BASE_WORK_STEALING_DEQUE_H
@@ -0,0 +1,86 @@
+#include "base/work_stealing_deque.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/unittest.h"
+
+namespace {
+
+void steal(WorkStealingDeque<int>* deque, std::atomic<bool>* done,
+           std::vector<int>* taken) {
+  for (;;) {
+    bool was_done = *done;
+    int* item = deque->Steal();
+    if (item)
+      taken->push_back(*item);
+    else if (was_done)
+      break;
+  }
+}
+
+}  // namespace
+
+TEST(WorkStealingDeque, Order) {
+  WorkStealingDeque<int> deque;
+  int items[1000];
+  EXPECT_TRUE(deque.empty());
+  EXPECT_FALSE(deque.Take());
+  EXPECT_FALSE(deque.Steal());
+
+  // More than the initial size, so that it grows.
+  for (int i = 0; i < 1000; ++i) {
+    items[i] = i;
+    deque.Push(&items[i]);
+  }
+  EXPECT_FALSE(deque.empty());
+
+  // The owner takes the newest, and thieves steal the oldest.
+  EXPECT_EQ(&items[999], deque.Take());
+  EXPECT_EQ(&items[0], deque.Steal());
+  EXPECT_EQ(&items[998], deque.Take());
+  EXPECT_EQ(&items[1], deque.Steal());
+  for (int i = 997; i >= 2; --i)
+    ASSERT_EQ(&items[i], deque.Take());
+  EXPECT_TRUE(deque.empty());
+  EXPECT_FALSE(deque.Take());
+  EXPECT_FALSE(deque.Steal());
+}
+
+TEST(WorkStealingDeque, Thieves) {
+  const int kThieves = 4;
+  const int kItems = 100000;
+  WorkStealingDeque<int> deque;
+  std::vector<int> items(kItems);
+  std::vector<std::vector<int>> stolen(kThieves);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThieves; ++i)
+    threads.push_back(std::thread(Bind(steal, &deque, &done, &stolen[i])));
+
+  // Every item is taken exactly once, by the owner or by a thief.
+  std::vector<int> count(kItems, 0);
+  for (int i = 0; i < kItems; ++i) {
+    items[i] = i;
+    deque.Push(&items[i]);
+    if (i % 3 == 0) {
+      int* item = deque.Take();
+      if (item)
+        count[*item]++;
+    }
+  }
+  while (int* item = deque.Take())
+    count[*item]++;
+  done = true;
+  for (std::thread& t: threads)
+    t.join();
+
+  for (const std::vector<int>& taken: stolen) {
+    for (int i: taken)
+      count[i]++;
+  }
+  for (int i = 0; i < kItems; ++i)
+    ASSERT_EQ(1, count[i]) << i;
+}